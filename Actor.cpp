@@ -1,42 +1,53 @@
 #include "stdafx.h"
 #include "Actor.h"
+#include "FixedTimestep.h"
 #include "World.h"
+#include "WorldCommands.h"
 
 #include "WorldGenerator.h" // For drawing on level
 
-void Character::onReady(World &world)
+namespace
 {
-    world.registerForCollision(this);
-}
+    // what touching an actor of the kind does to a tank, by kind
+    using TankContact = void (*)(Tank &tank, Actor &other, float dt);
+    const std::array<TankContact, static_cast<size_t>(ActorKind::Count)> TankContacts{
+        nullptr, // tanks pass through each other
+        [](Tank &tank, Actor &, float)
+        {
+            // the base refills the ammunition
+            for (auto &weapon : tank.getWeaponList())
+                weapon.amunition = std::max(weapon.amunition, weapon.fullAmunition);
+        },
+        [](Tank &tank, Actor &enemy, float dt) { tank.damage(static_cast<Enemy &>(enemy).getNearDamage() * dt); },
+    };
+    constexpr auto TankContactKinds = MaskOf(ActorKind::Base, ActorKind::Enemy);
 
-void Character::draw(sf::RenderTarget &target, sf::RenderStates states) const
-{
-    target.draw(sprite, states);
-}
+    // of the push from overlapping enemies against the unit step towards the target
+    constexpr float SeparationWeight = 2.0f;
+    // in the thick of a swarm a few neighbours are enough to find the way out, and the cost stays the same
+    constexpr int MaxSeparationNeighbours = 6;
 
-float Character::directionToAngle(glm::vec2 dir)
-{
-    if (length(dir) > 0.001f)
-    {
-        return glm::degrees(atan2f(dir.y, dir.x)) + 90.0f;
-    }
+    // of its own time between the changes an enemy makes to the world
+    constexpr int EnemyEditTicks = 50;
+    constexpr float EnemyEditInterval = EnemyEditTicks * FixedTimestep::TickDuration;
+} // namespace
 
-    return 0;
+void Character::onReady(World &world)
+{
+    world.registerForCollision(this);
 }
 
-void Character::updateWeapon(float dt, World &world)
+void Character::updateWeapon(float dt, WorldCommands &commands)
 {
     if (shootTrigger && activeWeapon < weaponList.size())
     {
         auto &weapon = weaponList[activeWeapon];
         if (weapon.reloadTimer <= 0.01f && weapon.amunition > 0)
         {
-            if (auto effect = weapon.effectFactory(*this, shootDirection))
+            if (weapon.fire(*this, shootDirection, commands))
             {
                 weapon.amunition--;
                 weapon.reloadTimer = weapon.reloadTime;
-
-                world.addActor(std::move(effect));
             }
         }
     }
@@ -49,17 +60,14 @@ void Character::updateWeapon(float dt, World &world)
     shootTrigger = false;
 }
 
-void Character::update(float dt, World &world)
+void Character::update(float dt, const World &world, WorldCommands &commands)
 {
-    sprite.setPosition(position.x, position.y);
-    sprite.setOrigin(sprite.getTexture()->getSize().x / 2, sprite.getTexture()->getSize().y / 2);
+    // both cells at once, the one ahead is looked up again only if falling took us to the next layer
+    const std::array points{glm::ivec3{position}, glm::ivec3{getPositionOnLayer() + getVelocity() * dt, position.z}};
+    std::array<World::CellType, 2> cells{};
+    world.categorizeTiles(points, cells);
 
-    const auto maxDimension = std::max(sprite.getTexture()->getSize().x, sprite.getTexture()->getSize().y);
-    const auto scale = static_cast<float>(getSize() * 2) / maxDimension;
-    sprite.setScale(scale, scale);
-    sprite.setRotation(glm::degrees(rotation) + 90.0f);
-
-    const auto tileBeneath = world.categorizeTile(glm::ivec3{position});
+    const auto tileBeneath = cells[0];
     if (tileBeneath == World::CellType::Unloaded)
         return;
 
@@ -67,23 +75,18 @@ void Character::update(float dt, World &world)
         position.z += 1.0f * dt;
 
     const auto newPos = glm::vec3{getPositionOnLayer() + getVelocity() * dt, getPosition().z};
-    const auto tileAhead = world.categorizeTile(glm::ivec3{newPos});
+    auto tileAhead = cells[1];
+    if (glm::ivec3{newPos}.z != points[1].z)
+        tileAhead = world.categorizeTile(glm::ivec3{newPos});
     if (tileAhead == World::CellType::Floor)
         setPosition(newPos);
     else
         velocity = {};
 
-    updateWeapon(dt, world);
+    updateWeapon(dt, commands);
 
 }
 
-void Tank::draw(sf::RenderTarget &target, sf::RenderStates states) const
-{
-    target.draw(sprite, states);
-    target.draw(drillSprite, states);
-    target.draw(towerSprite, states);
-}
-
 void Base::onReady(World &world)
 {
     Character::onReady(world);
@@ -95,27 +98,9 @@ void Base::onReady(World &world)
     world.unregisterForCollision(this);
 }
 
-void Base::update(float dt, World &world)
-{
-    Character::update(dt, world);
-}
-
-void Effect::update(float dt, World &world)
+void Base::update(float dt, const World &world, WorldCommands &commands)
 {
-    position.x += velocity.x * dt;
-    position.y += velocity.y * dt;
-
-    size += sizeVelocity * dt;
-    lifetime -= dt;
-
-    sprite.setRotation(sprite.getRotation() + angularVelocity * dt);
-    sprite.setPosition(position.x, position.y);
-    sprite.setOrigin(sprite.getTexture()->getSize().x / 2, sprite.getTexture()->getSize().y / 2);
-    sprite.setColor(sf::Color{255, 255, 255, static_cast<sf::Uint8>(255 * lifetime / initialLifetime)});
-
-    const auto maxDimension = std::max(sprite.getTexture()->getSize().x, sprite.getTexture()->getSize().y);
-    const auto scale = static_cast<float>(size) / maxDimension;
-    sprite.setScale(scale, scale);
+    Character::update(dt, world, commands);
 }
 
 void Tank::onReady(World &world)
@@ -128,100 +113,105 @@ void Tank::onReady(World &world)
     FillRoundArea(*layer, getPositionOnLayer(), getSize() * 4);
 }
 
-void Tank::update(float dt, World &world)
+void Tank::update(float dt, const World &world, WorldCommands &commands)
 {
-    Character::update(dt, world);
-
-    towerSprite.setOrigin(sprite.getOrigin() + sf::Vector2f{0.0, 50.0f});
-    towerSprite.setPosition(sprite.getPosition());
-    towerSprite.setScale(sprite.getScale());
-    towerSprite.setRotation(directionToAngle(shootDirection));
-
-    const auto angle = glm::radians(sprite.getRotation() - 90.0f);
-
-    drillSprite.setOrigin(sprite.getOrigin());
-    drillSprite.setScale(sprite.getScale());
-    drillSprite.setRotation(sprite.getRotation());
-    drillSprite.setPosition(sprite.getPosition() + sf::Vector2f{cos(angle), sin(angle)} * 2.0f );
-
-    const auto& collisions =  world.queryPoint(getPosition());
-    for (auto* object : collisions)
-    {
-        if (auto *base = dynamic_cast<Base*>(object))
-        {
-            for (auto& weapon : weaponList)
-                weapon.amunition = std::max(weapon.amunition, weapon.fullAmunition);
-        }
-        else if (auto *enemy = dynamic_cast<Enemy *>(object))
-        {
-            damage(enemy->getNearDamage() * dt);
-        }
-    }
-}
-
-void Effect::draw(sf::RenderTarget &target, sf::RenderStates states) const
-{
-    states.blendMode = sf::BlendMode{sf::BlendMode::SrcAlpha, sf::BlendMode::One};
-    target.draw(sprite, states);
-}
-
-void Bullet::update(float dt, World &world)
-{
-    Effect::update(dt, world);
-
-    const auto currentTileType = world.categorizeTile(getPosition());
-    if (currentTileType == World::CellType::Wall || !world.queryPoint(getPosition()).empty())
-    {
-        lifetime = 0.0f;
-        if (payload)
-        {
-            payload->setPosition(getPosition());
-            world.addActor(std::move(payload));
-            return;
-        }
-    }
+    Character::update(dt, world, commands);
 
+    world.queryPoint(getPosition(), contacts, TankContactKinds);
+    for (auto *object : contacts)
+        TankContacts[static_cast<size_t>(object->getKind())](*this, *object, dt);
 }
 
-void Enemy::update(float dt, World &world)
+void Enemy::update(float dt, const World &world, WorldCommands &commands)
 {
-    Character::update(dt, world);
+    Character::update(dt, world, commands);
 
-    if (auto chasingObj = chasingActor.lock())
+    if (const auto *chasingObj = world.findActor(chasingActor))
     {
-        const auto dir = (chasingObj->getPositionOnLayer() - getPositionOnLayer());
+        // around the walls when the shared field reaches us, straight through them otherwise
+        const auto *field = world.findFlowField(chasingActor);
+        if (!field)
+            commands.trackActor(chasingActor);
+        const auto path = field ? field->getDirection(getPosition()) : std::nullopt;
+
+        auto dir = (xy(chasingObj->getPreviousPosition()) - getPositionOnLayer());
+        if (path && length(*path) > 0)
+            dir = *path;
+        // a swarm spreads around the target instead of piling up on it
+        if (length(dir) > 0)
+            dir = normalize(dir);
+        dir += getSeparation(world) * SeparationWeight;
         if (length(dir) > 0)
         {
             setRotation(atan2f(dir.y, dir.x));
             setVelocity(normalize(dir) * getMaxSpeed());
         }
 
+        if (path)
+            return;
+
         const auto newPos = glm::vec3{getPositionOnLayer() + getVelocity() * dt, getPosition().z};
         const auto tileAhead = world.categorizeTile(glm::ivec3{newPos});
 
-        auto *layer = world.getLayer(getPosition().z);
-        auto *layerBeneath = world.getLayer(getPosition().z + 1);
+        const auto *layer = world.getLayer(getPosition().z);
+        const auto *layerBeneath = world.getLayer(getPosition().z + 1);
 
-        if (!layerBeneath || !layer)
+        if (!layerBeneath || !layer || !layer->isLoaded(xy(newPos)) || !layerBeneath->isLoaded(xy(newPos)))
             return;
 
-        // Changes the world synchronously and one time per 50 frames
-        if (world.getFrameStamp() % 50 != 0)
+        // Changes the world once in a while, after all of the actors have been updated.
+        // Counted in its own time, so enemies the world updates less often change it as often
+        editTimer += dt;
+        if (editTimer < EnemyEditInterval)
             return;
+        editTimer = 0.0f;
         
         if (tileAhead == World::CellType::Wall && buildingRange <= 0)
         {
-            layerBeneath->getTile(xy(newPos)) = layer->getTile(xy(newPos));
-            layer->getTile(xy(newPos)) = Tile::Empty();
+            commands.moveTileDown(glm::ivec3{newPos});
         }
         else if (tileAhead == World::CellType::Empty || tileAhead == World::CellType::Wall  && buildingRange > 0)
         {
-            FillRoundArea(*layer, getPositionOnLayer(), buildingRange);
+            const auto center = glm::ivec3{getPosition()};
+            commands.fillRoundArea(center, buildingRange);
 
             Tile tile{};
             tile.classId = 10;
             tile.actualStrength = 1;
-            FillRoundArea(*layerBeneath, getPositionOnLayer(), buildingRange, tile);
+            commands.fillRoundArea(center + glm::ivec3{0, 0, 1}, buildingRange, tile);
         }
     }
-}
\ No newline at end of file
+}
+
+void Enemy::onReady(World &world)
+{
+    Character::onReady(world);
+
+    // enemies blocked at once spread their changes over the interval instead of making them in one tick
+    editTimer = static_cast<float>(getHandle().index * 2654435761u % EnemyEditTicks) * FixedTimestep::TickDuration;
+}
+
+glm::vec2 Enemy::getSeparation(const World &world) const
+{
+    const auto position = getPreviousPosition();
+    const auto size = static_cast<float>(getSize());
+
+    glm::vec2 push{0.0f};
+    int neighbours = 0;
+    world.getCrowd().visit(position, size, MaskOf(ActorKind::Enemy), [&](const CrowdGrid::Member &other)
+    {
+        if (other.handle == getHandle())
+            return true;
+
+        auto away = xy(position) - other.position;
+        const auto distance = length(away);
+        // right on top of each other, the two are pushed apart in opposite directions
+        if (distance < 0.001f)
+            away = {other.handle.index < getHandle().index ? 1.0f : -1.0f, 0.0f};
+        else
+            away /= distance;
+        push += away * (1.0f - distance / (size + other.size));
+        return ++neighbours < MaxSeparationNeighbours;
+    });
+    return push;
+}
@@ -1,13 +1,19 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
+#include "ActorKind.h"
+#include "SlotMap.h"
 
 class World;
+class WorldCommands;
 
-class Actor : public sf::Drawable // TODO: ActorRenderer, remove shared_from_this
+using ActorHandle = SlotHandle;
+
+class Actor
 {
 public:
-    virtual void update(float dt, World &world) = 0;
+    // Runs in parallel with the updates of other actors. The world is only read meanwhile, changes to it go through
+    // the commands. Other actors may be moving, so only their previous positions can be read
+    virtual void update(float dt, const World &world, WorldCommands &commands) = 0;
 
     virtual void onReady(World& world){}
     virtual void onDestroy(World &world) {}
@@ -20,23 +26,54 @@ public:
 
     bool isAlive() const { return world && isAliveImpl(); }
 
+    // fixed for the lifetime of the actor, so that collisions can be told apart without RTTI
+    ActorKind getKind() const { return kind; }
+
+    // Where the actor was before its last update, frames are drawn in between over the update interval.
+    // During the tick it is where the other actors see this one
+    void setPreviousPosition(glm::vec3 position) { previousPosition = position; }
+    glm::vec3 getPreviousPosition() const { return previousPosition; }
+
     void setWorld(const World *_world) { world = _world; }
     const World *getWorld() const { return world; }
 
+    // set by the world right before onReady, once the ground around the actor is loaded
+    void setReady(bool _ready) { ready = _ready; }
+    bool isReady() const { return ready; }
+
+    // Set by the world for actors it updates less often than every tick: the time since the last update,
+    // the time the last update covered and whether the next tick has to update the actor anyway
+    void setSkippedTime(float time) { skippedTime = time; }
+    float getSkippedTime() const { return skippedTime; }
+    void setUpdateInterval(float interval) { updateInterval = interval; }
+    float getUpdateInterval() const { return updateInterval; }
+    void setPromoted(bool _promoted) { promoted = _promoted; }
+    bool isPromoted() const { return promoted; }
+
+    // given by the world when the actor is added, World::findActor finds nothing once it has been removed
+    void setHandle(ActorHandle _handle) { handle = _handle; }
+    ActorHandle getHandle() const { return handle; }
+
     virtual ~Actor() = default;
 
 protected:
+    explicit Actor(ActorKind kind) : kind{kind} {}
 
     virtual bool isAliveImpl() const = 0;
 private:
+    const ActorKind kind;
     const World *world = nullptr;
-
-    //virtual void draw(sf::RenderTarget &target, sf::RenderStates states) const override {}
+    ActorHandle handle;
+    glm::vec3 previousPosition{0};
+    float skippedTime = 0.0f, updateInterval = 0.0f;
+    bool ready = false;
+    bool promoted = false;
 };
 
 struct Weapon
 {
-    std::function<std::unique_ptr<class Effect>(class Character& instigator, glm::vec2 direction)> effectFactory;
+    // asks the world to spawn the shot, false if nothing was fired
+    std::function<bool(class Character &instigator, glm::vec2 direction, WorldCommands &commands)> fire;
 
     float reloadTime = 0.2f;
     int amunition = 100;
@@ -58,7 +95,7 @@ public:
     float getRotation() const { return rotation; }
     glm::vec2 getFrontDirection() const { return {cos(rotation), sin(rotation)}; }
 
-    void update(float dt, World &world) override;
+    void update(float dt, const World &world, WorldCommands &commands) override;
 
     void setSize(uint8_t _size) override { size = _size; }
     uint8_t getSize() const override { return size; }
@@ -71,6 +108,7 @@ public:
     void setActiveWeapon(size_t weaponIndex) { activeWeapon = weaponIndex; }
     void triggerShoot() { shootTrigger = true; }
     void setShootDirection(glm::vec2 _dir) { shootDirection = _dir; }
+    glm::vec2 getShootDirection() const { return shootDirection; }
 
     std::vector<Weapon> &getWeaponList() { return weaponList; }
 
@@ -80,17 +118,16 @@ public:
 
     bool isAliveImpl() const override { return hp > 0.0f; }
 
-    void setTexture(const sf::Texture &texture) { sprite.setTexture(texture); }
+    // index of the look ActorRenderer draws the character with, the simulation doesn't use it
+    void setLook(uint8_t _look) { look = _look; }
+    uint8_t getLook() const { return look; }
 
     void onReady(World &world) override;
 
 protected:
-    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
-
-    static float directionToAngle(glm::vec2 dir);
+    explicit Character(ActorKind kind) : Actor{kind} {}
 
 protected:
-    sf::Sprite sprite;
     float rotation = 0.0f;
 
     size_t activeWeapon = 0;
@@ -99,13 +136,14 @@ protected:
     glm::vec2 shootDirection;
 
 private:
-    void updateWeapon(float dt, World &world);
+    void updateWeapon(float dt, WorldCommands &commands);
 
 private:
     glm::vec3 position = {};
     glm::vec2 velocity = {};
     float hp = 1.0f;
     uint8_t size = 1;
+    uint8_t look = 0;
     float maxSpeed = 1.0;
 };
 
@@ -120,119 +158,45 @@ public:
     } inventory;
 
 public:
-    void onReady(World &world) override;
-    void update(float dt, World &world) override;
-
-    void setAdditionalTextures(const sf::Texture &towerTexture, const sf::Texture &drillTexture)
-    {
-        towerSprite.setTexture(towerTexture);
-        drillSprite.setTexture(drillTexture);
-    }
+    Tank() : Character{ActorKind::Tank} {}
 
-protected:
-    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+    void onReady(World &world) override;
+    void update(float dt, const World &world, WorldCommands &commands) override;
 
 private:
-    sf::Sprite towerSprite;
-    sf::Sprite drillSprite;
+    std::vector<Actor *> contacts; // query buffer kept between updates
 };
 
 class Base : public Character
 {
 public:
-    void onReady(World &world) override;
-    void update(float dt, World &world) override;
-};
-
-
-//very dumb and inefficient particles, but we must hurry
-//probably will do some game logic on appear
-class Effect : public Actor
-{
-public:
-    /*
-     *     glm::vec3 position = {};
-    glm::vec2 velocity = {};
-    sf::Sprite sprite;
-    float lifetime = 1.0f;
-
-    float angularVelocity = 0.0f;
-    float sizeVelocity = 0.0f;
-    float size = 1.0f;
+    Base() : Character{ActorKind::Base} {}
 
-    std::function<void(World &)> onAppear;
-     */
-    Effect(glm::vec3 position, glm::vec2 velocity, float lifetime, float angularVelocity = 0.0f, float sizeVelocity = 0.0f, float initialSize = 1.0f, std::function<void(Effect&, World &)> onAppear = {}) :
-        position{position},
-        velocity{velocity}, lifetime{lifetime}, angularVelocity{angularVelocity},
-        sizeVelocity{sizeVelocity}, size{initialSize}, onAppear {std::move(onAppear)} {}
-    Effect() = default;
-
-    void setVelocity(glm::vec2 _velocity) { velocity = _velocity; }
-    glm::vec2 getVelocity() const { return velocity; }
-
-    void update(float dt, World &world) override;
-
-    void setSize(uint8_t _size) override { size = _size; }
-    void setSize(float _size) { size = _size; }
-    uint8_t getSize() const override { return size; }
-
-    void setPosition(glm::vec3 _position) override { position = _position; }
-    glm::vec3 getPosition() const override { return position; }
-    glm::vec2 getPositionOnLayer() const { return {position.x, position.y}; }
-
-    bool isAliveImpl() const override { return lifetime > 0.0 && size > 0.0f; }
-
-    void setTexture(const sf::Texture &texture) { sprite.setTexture(texture); }
-
-protected:
-    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
-
-    void onReady(World &world) override { if (onAppear) onAppear(*this, world); }
-
-protected:
-    glm::vec3 position = {};
-    glm::vec2 velocity = {};
-    sf::Sprite sprite;
-    float lifetime = 1.0f;
-    float initialLifetime = lifetime;
-
-    float angularVelocity = 0.0f;
-    float sizeVelocity = 0.0f;
-    float size = 1.0f;
-
-    std::function<void(Effect&,World &)> onAppear;
+    void onReady(World &world) override;
+    void update(float dt, const World &world, WorldCommands &commands) override;
 };
 
-class Bullet : public Effect
-{
-public:
-    Bullet() = default;
-    Bullet(glm::vec3 position, glm::vec2 velocity)
-    {
-        setPosition(position);
-        setVelocity(velocity);
-    }
-    void update(float dt, World &world) override;
-
-    void setPayload(std::unique_ptr<Effect> effect) { payload = std::move(effect); }
-
-private:
-    std::unique_ptr<Effect> payload;
-};
 
 class Enemy : public Character
 {
 public:
-    void update(float dt, World &world) override;
+    Enemy() : Character{ActorKind::Enemy} {}
+
+    void onReady(World &world) override;
+    void update(float dt, const World &world, WorldCommands &commands) override;
 
     float getNearDamage() const { return nearDamage; }
     void setNearDamage(float damage) { nearDamage = damage; }
 
     int buildingRange = 0;
-    std::weak_ptr<Character> chasingActor;
+    ActorHandle chasingActor;
+
+private:
+    // away from the enemies this one overlaps, longer the deeper they overlap
+    glm::vec2 getSeparation(const World &world) const;
 
 private:
     float nearDamage = 0.1;
+    float editTimer = 0.0f;
 };
 
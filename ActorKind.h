@@ -0,0 +1,24 @@
+#pragma once
+
+// What an actor is for collisions and contacts. Masks have bit 1 << kind set for every kind in them
+enum class ActorKind : uint8_t
+{
+    Tank,
+    Base,
+    Enemy,
+
+    Count
+};
+
+using ActorKindMask = uint8_t;
+static_assert(static_cast<int>(ActorKind::Count) <= 8, "kinds don't fit the mask");
+
+template <typename... Kinds>
+constexpr ActorKindMask MaskOf(Kinds... kinds)
+{
+    return static_cast<ActorKindMask>(((1u << static_cast<int>(kinds)) | ... | 0u));
+}
+
+constexpr ActorKindMask AnyActorKind = std::numeric_limits<ActorKindMask>::max();
+// every kind is a Character so far
+constexpr ActorKindMask CharacterKinds = MaskOf(ActorKind::Tank, ActorKind::Base, ActorKind::Enemy);
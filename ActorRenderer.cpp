@@ -0,0 +1,51 @@
+#include "stdafx.h"
+#include "ActorRenderer.h"
+#include "Actor.h"
+
+namespace
+{
+    // sprites look up at zero degrees
+    float DirectionToAngle(glm::vec2 dir)
+    {
+        if (length(dir) > 0.001f)
+            return glm::degrees(atan2f(dir.y, dir.x)) + 90.0f;
+
+        return 0.0f;
+    }
+} // namespace
+
+void ActorRenderer::draw(sf::RenderTarget &target, const sf::RenderStates &states, const Actor &actor,
+                         glm::vec3 position) const
+{
+    if (!(MaskOf(actor.getKind()) & CharacterKinds))
+        return;
+
+    const auto &character = static_cast<const Character &>(actor);
+    if (character.getLook() >= looks.size() || !looks[character.getLook()].body)
+        return;
+
+    const auto &look = looks[character.getLook()];
+    const auto bodySize = look.body->getSize();
+    const auto origin = sf::Vector2f{bodySize.x / 2.0f, bodySize.y / 2.0f};
+    const auto scale = static_cast<float>(character.getSize() * 2) / std::max(bodySize.x, bodySize.y);
+    const auto rotation = glm::degrees(character.getRotation()) + 90.0f;
+
+    auto drawPart = [&](const sf::Texture &texture, sf::Vector2f partOrigin, glm::vec2 partPosition, float angle)
+    {
+        sprite.setTexture(texture, true);
+        sprite.setOrigin(partOrigin);
+        sprite.setPosition(partPosition.x, partPosition.y);
+        sprite.setScale(scale, scale);
+        sprite.setRotation(angle);
+        target.draw(sprite, states);
+    };
+
+    drawPart(*look.body, origin, xy(position), rotation);
+    if (look.drill)
+        drawPart(*look.drill, origin, xy(position) + character.getFrontDirection() * 2.0f, rotation);
+    if (look.tower)
+    {
+        drawPart(*look.tower, origin + sf::Vector2f{0.0f, 50.0f}, xy(position),
+                 DirectionToAngle(character.getShootDirection()));
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+class Actor;
+
+// Draws characters from their state, the simulation keeps no sprites of its own
+class ActorRenderer
+{
+public:
+    // textures must outlive the renderer, tower and drill are drawn only when given
+    struct Look
+    {
+        const sf::Texture *body = nullptr;
+        const sf::Texture *tower = nullptr; // turned towards the shoot direction
+        const sf::Texture *drill = nullptr; // a bit ahead of the body
+    };
+
+    // indexed by Character::getLook()
+    void setLooks(std::vector<Look> _looks) { looks = std::move(_looks); }
+
+    // at the position given instead of the actor's own one, so that frames can be drawn between ticks
+    void draw(sf::RenderTarget &target, const sf::RenderStates &states, const Actor &actor, glm::vec3 position) const;
+
+private:
+    std::vector<Look> looks;
+    mutable sf::Sprite sprite; // kept between draws
+};
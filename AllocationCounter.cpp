@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<size_t> allocationsCount{0};
+
+    void *Allocate(size_t size)
+    {
+        allocationsCount.fetch_add(1, std::memory_order_relaxed);
+        if (void *memory = std::malloc(size ? size : 1))
+            return memory;
+        throw std::bad_alloc{};
+    }
+
+    void *AllocateAligned(size_t size, std::align_val_t alignment)
+    {
+        allocationsCount.fetch_add(1, std::memory_order_relaxed);
+        const auto bytes = static_cast<size_t>(alignment);
+#ifdef _MSC_VER
+        void *memory = _aligned_malloc(size ? size : 1, bytes);
+#else
+        void *memory = std::aligned_alloc(bytes, (std::max<size_t>(size, 1) + bytes - 1) / bytes * bytes);
+#endif
+        if (memory)
+            return memory;
+        throw std::bad_alloc{};
+    }
+
+    void FreeAligned(void *memory)
+    {
+#ifdef _MSC_VER
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+} // namespace
+
+std::optional<size_t> GetAllocationsCount()
+{
+    return allocationsCount.load(std::memory_order_relaxed);
+}
+
+// the array and nothrow forms of the standard library call these ones
+void *operator new(size_t size)
+{
+    return Allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+#else
+
+std::optional<size_t> GetAllocationsCount()
+{
+    return std::nullopt;
+}
+
+#endif
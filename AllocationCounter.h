@@ -0,0 +1,5 @@
+#pragma once
+
+// Allocations made through the global operator new since the program started, by every thread. Counted only when
+// AllocationCounter.cpp is built with COUNT_ALLOCATIONS, which replaces the operator, nothing otherwise
+std::optional<size_t> GetAllocationsCount();
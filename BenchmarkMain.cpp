@@ -0,0 +1,8 @@
+#include "stdafx.h"
+#include "Benchmarks.h"
+
+int main(int argc, char *argv[])
+{
+    const std::vector<std::string_view> args(argv + 1, argv + argc);
+    return RunBenchmark(args);
+}
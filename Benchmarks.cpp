@@ -0,0 +1,428 @@
+#include "stdafx.h"
+#include "Benchmarks.h"
+
+#include <bit>
+#include <fstream>
+#include <numeric>
+#include <utility>
+
+#include "Actor.h"
+#include "AllocationCounter.h"
+#include "FixedTimestep.h"
+#include "JobSystem.h"
+#include "NoiseKernel.h"
+#include "WorldGenerator.h"
+
+namespace
+{
+    using BenchmarkClock = std::chrono::steady_clock;
+
+    int ParseIntOr(std::span<const std::string_view> args, size_t index, int fallback)
+    {
+        if (index >= args.size())
+            return fallback;
+
+        return std::stoi(std::string{args[index]});
+    }
+
+    uint64_t ParseSeedOr(std::span<const std::string_view> args, size_t index, uint64_t fallback)
+    {
+        if (index >= args.size())
+            return fallback;
+
+        return std::stoull(std::string{args[index]});
+    }
+
+    // layers are generated deepest first when reversed, results must not depend on the order
+    std::vector<uint64_t> GenerateLayers(WorldGenerator &generator, int numLayers, bool reversed,
+                                         double &layersPerSecond)
+    {
+        std::vector<uint64_t> hashes(numLayers);
+
+        const auto start = BenchmarkClock::now();
+        for (int i = 0; i < numLayers; ++i)
+        {
+            const int depth = reversed ? numLayers - 1 - i : i;
+
+            LevelLayer layer{glm::ivec2{generator.getLayerDimensions()}, depth};
+            generator.generateLevelLayer(layer);
+            hashes[depth] = layer.getContentHash();
+        }
+        const std::chrono::duration<double> elapsed = BenchmarkClock::now() - start;
+
+        layersPerSecond = numLayers / elapsed.count();
+        return hashes;
+    }
+
+    size_t CountMismatches(std::span<const uint64_t> hashes, std::span<const uint64_t> reference)
+    {
+        size_t mismatches = 0;
+        for (size_t depth = 0; depth < hashes.size(); ++depth)
+            mismatches += depth >= reference.size() || hashes[depth] != reference[depth];
+        return mismatches;
+    }
+
+    // The golden file is "seed <seed>" followed by a hash per depth. Missing files are recorded, so
+    // the first run on a known good build makes the reference for the next ones
+    bool CheckGoldenHashes(const std::string &path, uint64_t seed, std::span<const uint64_t> hashes)
+    {
+        if (std::ifstream input{path}; input)
+        {
+            std::string keyword;
+            uint64_t goldenSeed = 0;
+            input >> keyword >> goldenSeed;
+            if (keyword != "seed"s || goldenSeed != seed)
+            {
+                std::printf("golden file %s is for another seed\n", path.c_str());
+                return false;
+            }
+
+            std::vector<uint64_t> golden;
+            for (uint64_t hash = 0; input >> std::hex >> hash;)
+                golden.push_back(hash);
+
+            const auto count = std::min(golden.size(), hashes.size());
+            const auto mismatches = CountMismatches(hashes.first(count), golden);
+            std::printf("layers differing from %s: %zu of %zu\n", path.c_str(), mismatches, count);
+            // layers the file doesn't have can't be checked, extra layers in the file are fine
+            if (count < hashes.size())
+            {
+                std::printf("golden file %s has only %zu of %zu layers\n", path.c_str(), golden.size(),
+                            hashes.size());
+            }
+            return mismatches == 0 && count == hashes.size();
+        }
+
+        std::ofstream output{path};
+        output << "seed " << seed << '\n';
+        for (auto hash : hashes)
+            output << std::hex << hash << '\n';
+
+        std::printf("golden hashes recorded to %s\n", path.c_str());
+        return static_cast<bool>(output);
+    }
+
+    // generator [layers = 16] [seed = 1] [golden file]: layers/sec of the libnoise path and of the batch kernel.
+    // Layer hashes must agree between the backends, worker counts, generation orders and the golden file
+    int RunGeneratorBenchmark(std::span<const std::string_view> args)
+    {
+        const int numLayers = ParseIntOr(args, 0, 16);
+        const uint64_t seed = ParseSeedOr(args, 1, 1);
+
+        const auto &kernel = NoiseKernel::Instance();
+        std::printf("noise kernel: %s, self check error %g (tolerance %g)\n", kernel.isVectorized() ? "AVX2" : "scalar",
+                    kernel.getMeasuredError(), NoiseKernel::Tolerance);
+
+        auto jobSystem = std::make_shared<JobSystem>();
+        auto generator = std::make_shared<WorldGenerator>(glm::uvec2{256, 256}, seed, jobSystem);
+        std::printf("%zu workers, %d layers of 256x256, seed %llu\n", jobSystem->getWorkersCount(), numLayers,
+                    static_cast<unsigned long long>(seed));
+
+        bool passed = true;
+        double libNoiseSpeed = 0.0, kernelSpeed = 0.0, serialSpeed = 0.0;
+
+        generator->setNoiseBackend(WorldGenerator::NoiseBackend::LibNoise);
+        const auto reference = GenerateLayers(*generator, numLayers, false, libNoiseSpeed);
+        std::printf("libnoise:     %8.2f layers/sec\n", libNoiseSpeed);
+
+        if (kernel.isAccurate())
+        {
+            generator->setNoiseBackend(WorldGenerator::NoiseBackend::BatchKernel);
+            const auto batched = GenerateLayers(*generator, numLayers, false, kernelSpeed);
+            std::printf("batch kernel: %8.2f layers/sec (x%.2f)\n", kernelSpeed, kernelSpeed / libNoiseSpeed);
+
+            const auto mismatches = CountMismatches(batched, reference);
+            std::printf("layers differing from libnoise: %zu\n", mismatches);
+            passed &= mismatches == 0;
+        }
+        else
+        {
+            std::printf("batch kernel disagrees with libnoise, skipped\n");
+            passed = false;
+        }
+
+        {
+            // the default backend again, on a single worker and deepest layer first
+            auto serialJobSystem = std::make_shared<JobSystem>(1);
+            auto serialGenerator = std::make_shared<WorldGenerator>(glm::uvec2{256, 256}, seed, serialJobSystem);
+            const auto serial = GenerateLayers(*serialGenerator, numLayers, true, serialSpeed);
+
+            const auto mismatches = CountMismatches(serial, reference);
+            std::printf("1 worker, reversed: %8.2f layers/sec, layers differing: %zu\n", serialSpeed, mismatches);
+            passed &= mismatches == 0;
+        }
+
+        if (args.size() > 2)
+            passed &= CheckGoldenHashes(std::string{args[2]}, seed, reference);
+
+        std::printf("%s\n", passed ? "passed" : "FAILED");
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    template <typename Pass>
+    double MeasureNanosecondsPerTile(int passes, size_t tilesPerPass, Pass &&pass)
+    {
+        const auto start = BenchmarkClock::now();
+        for (int i = 0; i < passes; ++i)
+            pass();
+        const std::chrono::duration<double, std::nano> elapsed = BenchmarkClock::now() - start;
+
+        return elapsed.count() / (static_cast<double>(passes) * tilesPerPass);
+    }
+
+    // visit [passes = 200] [seed = 1]: per tile cost of the std::function visits, the templated ones and the row
+    // visits over a generated 256x256 layer. Reads must agree, an even number of toggling writes must restore it
+    int RunVisitBenchmark(std::span<const std::string_view> args)
+    {
+        const int passes = std::max(2, ParseIntOr(args, 0, 200) & ~1);
+        const uint64_t seed = ParseSeedOr(args, 1, 1);
+
+        auto jobSystem = std::make_shared<JobSystem>();
+        auto generator = std::make_shared<WorldGenerator>(glm::uvec2{256, 256}, seed, jobSystem);
+        LevelLayer layer{glm::ivec2{generator->getLayerDimensions()}, 0, generator->getSolidity()};
+        generator->generateLevelLayer(layer);
+
+        const auto size = layer.getSize();
+        const auto tiles = static_cast<size_t>(size.x) * size.y;
+        const auto hash = layer.getContentHash();
+        std::printf("%d passes over %dx%d tiles, seed %llu\n", passes, size.x, size.y,
+                    static_cast<unsigned long long>(seed));
+
+        bool passed = true;
+        int64_t functionSum = 0, templateSum = 0, rowSum = 0;
+
+        const auto functionRead = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            std::as_const(layer).visit([&](glm::ivec2, const Tile &tile) { functionSum += tile.actualStrength; });
+        });
+        const auto templateRead = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            std::as_const(layer).visitTiles({0, 0}, size, [&](glm::ivec2, const Tile &tile)
+            {
+                templateSum += tile.actualStrength;
+            });
+        });
+        const auto rowRead = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            std::as_const(layer).visitRows({0, 0}, size, [&](glm::ivec2, std::span<const TileClassId>,
+                                                             std::span<const int16_t> strengths)
+            {
+                rowSum += std::accumulate(strengths.begin(), strengths.end(), int64_t{0});
+            });
+        });
+        std::printf("read  std::function: %6.2f ns/tile, template: %6.2f ns/tile, rows: %6.2f ns/tile\n",
+                    functionRead, templateRead, rowRead);
+        passed &= functionSum == templateSum && functionSum == rowSum;
+
+        const auto functionWrite = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            layer.visit([](glm::ivec2, Tile &tile) { tile.actualStrength ^= 1; });
+        });
+        const auto templateWrite = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            layer.visitTiles({0, 0}, size, [](glm::ivec2, Tile &tile) { tile.actualStrength ^= 1; });
+        });
+        const auto rowWrite = MeasureNanosecondsPerTile(passes, tiles, [&]
+        {
+            layer.visitRows({0, 0}, size, [](glm::ivec2, std::span<TileClassId>, std::span<int16_t> strengths)
+            {
+                for (auto &strength : strengths)
+                    strength ^= 1;
+            });
+        });
+        std::printf("write std::function: %6.2f ns/tile, template: %6.2f ns/tile, rows: %6.2f ns/tile\n",
+                    functionWrite, templateWrite, rowWrite);
+        passed &= layer.getContentHash() == hash;
+
+        std::printf("%s\n", passed ? "passed" : "FAILED");
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    struct SimulationResult
+    {
+        uint64_t hash = 0; // of the state after the ticks
+        double ticksPerSecond = 0.0;
+        std::optional<double> allocationsPerTick; // see AllocationCounter.h
+        World::UpdateTimings timings; // summed over the ticks
+        size_t appliedTiles = 0, maxDeferredEdits = 0, droppedEdits = 0;
+    };
+
+    // A tank firing in circles at the center of a 1024x1024 world with enemies chasing and digging around it,
+    // stepped in fixed ticks as fast as possible. Actors are updated on the workers when parallelActors is set
+    SimulationResult SimulateHeadless(uint64_t seed, int ticks, int enemies, bool parallelActors)
+    {
+        auto jobSystem = std::make_shared<JobSystem>();
+        auto generator = std::make_shared<WorldGenerator>(glm::uvec2{1024, 1024}, seed, jobSystem);
+        const auto center = glm::vec2{512, 512};
+
+        World world;
+        world.setGenerator(generator);
+        if (parallelActors)
+            world.setJobSystem(jobSystem);
+        world.setStreamingAreas({{glm::ivec2{center} - 64, glm::ivec2{center} + 64}});
+        // a window of 128 x 128 tiles on the 16 top layers
+        World::SimulationFocus focus;
+        focus.views.assign(16, {glm::ivec2{center} - 64, glm::ivec2{center} + 64});
+        world.setSimulationFocus(focus);
+
+        // Everything the actors can reach is generated before the clock starts, and the frame stamp is aligned,
+        // so the run doesn't depend on the workers
+        auto isAreaLoaded = [&]
+        {
+            for (int depth = 0; depth < 32; ++depth)
+            {
+                const auto *layer = world.getLayer(depth);
+                for (int cy = 14; cy < 18; ++cy)
+                for (int cx = 14; cx < 18; ++cx)
+                {
+                    if (!layer || !layer->isChunkLoaded({cx, cy}))
+                        return false;
+                }
+            }
+            return true;
+        };
+        while (!isAreaLoaded() || world.getFrameStamp() % 50 != 0)
+        {
+            world.Update(0.0f);
+            std::this_thread::sleep_for(1ms);
+        }
+
+        auto tank = std::make_shared<Tank>();
+        tank->setSize(2);
+        tank->setHP(1e9f);
+        tank->setPosition({center, 0.0f});
+        tank->getWeaponList().push_back({[](Character &instigator, glm::vec2 direction, WorldCommands &commands)
+        {
+            ParticleSystem::Particle bullet;
+            bullet.position = instigator.getPosition() + glm::vec3{direction * 4.0f, 0.0f};
+            bullet.velocity = direction * 100.0f;
+
+            ParticleSystem::Particle flash;
+            flash.lifetime = 0.1f;
+            flash.sizeVelocity = 200.0f;
+
+            ParticleSystem::Explosion explosion;
+            explosion.radius = 6;
+            commands.spawnProjectile(bullet, flash, explosion);
+            return true;
+        }, 0.05f, std::numeric_limits<int>::max()});
+        world.addActor(tank);
+
+        auto random = generator->makeRandomStream(0);
+        std::uniform_real_distribution<float> offset{-44.0f, 44.0f}; // ActorReadyRadius inside of the area
+        for (int i = 0; i < enemies; ++i)
+        {
+            // every eleventh one is a slow builder
+            const bool builder = i % 11 == 10;
+            auto enemy = std::make_shared<Enemy>();
+            enemy->setSize(builder ? 4 : 2);
+            enemy->setMaxSpeed(builder ? 0.5f : 2.0f);
+            enemy->buildingRange = builder ? 2 : 0;
+            enemy->setPosition({center + glm::vec2{offset(random), offset(random)}, 0.0f});
+            enemy->chasingActor = tank->getHandle();
+            world.addActor(std::move(enemy));
+        }
+
+        SimulationResult result;
+        const auto allocationsBefore = GetAllocationsCount();
+        const auto start = BenchmarkClock::now();
+        for (int tick = 0; tick < ticks; ++tick)
+        {
+            const auto angle = static_cast<float>(tick) * 0.1f;
+            tank->setShootDirection({std::cos(angle), std::sin(angle)});
+            tank->triggerShoot();
+
+            world.Update(FixedTimestep::TickDuration);
+            world.getParticles().clearExplosions();
+
+            const auto &timings = world.getLastUpdateTimings();
+            result.timings.chunks += timings.chunks;
+            result.timings.flowFields += timings.flowFields;
+            result.timings.actors += timings.actors;
+            result.timings.commands += timings.commands;
+            result.timings.edits += timings.edits;
+            result.timings.particles += timings.particles;
+            result.timings.removal += timings.removal;
+
+            const auto &edits = world.getLastEditStats();
+            result.appliedTiles += edits.appliedTiles;
+            result.maxDeferredEdits = std::max(result.maxDeferredEdits, edits.deferredEdits);
+            result.droppedEdits += edits.droppedEdits;
+        }
+        const std::chrono::duration<double> elapsed = BenchmarkClock::now() - start;
+        result.ticksPerSecond = ticks / elapsed.count();
+        if (const auto allocationsAfter = GetAllocationsCount(); allocationsBefore && allocationsAfter)
+            result.allocationsPerTick = static_cast<double>(*allocationsAfter - *allocationsBefore) / ticks;
+
+        uint64_t hash = world.getLayer(0)->getContentHash();
+        for (const auto &actor : world.getActors())
+        {
+            const auto position = actor->getPosition();
+            hash = hash * 0x100000001b3ull ^ std::bit_cast<uint32_t>(position.x);
+            hash = hash * 0x100000001b3ull ^ std::bit_cast<uint32_t>(position.y);
+            hash = hash * 0x100000001b3ull ^ std::bit_cast<uint32_t>(position.z);
+        }
+        result.hash = hash * 0x100000001b3ull ^ world.getParticles().getCount();
+        return result;
+    }
+
+    void PrintSimulationResult(const char *name, const SimulationResult &result, int ticks)
+    {
+        std::printf("%-8s %8.1f ticks/sec (x%.1f of real time), ", name, result.ticksPerSecond,
+                    result.ticksPerSecond * FixedTimestep::TickDuration);
+        if (result.allocationsPerTick)
+            std::printf("%.1f allocations/tick\n", *result.allocationsPerTick);
+        else
+            std::printf("allocations not counted\n");
+
+        auto perTick = [ticks](std::chrono::nanoseconds time)
+        {
+            return std::chrono::duration<double, std::micro>{time}.count() / ticks;
+        };
+        const auto &timings = result.timings;
+        std::printf("         us/tick: chunks %.1f, flow fields %.1f, actors %.1f, commands %.1f, edits %.1f, "
+                    "particles %.1f, removal %.1f\n",
+                    perTick(timings.chunks), perTick(timings.flowFields), perTick(timings.actors),
+                    perTick(timings.commands), perTick(timings.edits), perTick(timings.particles),
+                    perTick(timings.removal));
+        std::printf("         %.1f edited tiles/tick, at most %zu edits deferred, %zu dropped\n",
+                    static_cast<double>(result.appliedTiles) / ticks, result.maxDeferredEdits, result.droppedEdits);
+    }
+
+    // simulation [ticks = 3600] [seed = 1] [enemies = 110]: ticks/sec, allocations and time of the phases of the tick
+    // of the headless simulation with the actors updated on one thread and on the workers, both runs must end the same
+    int RunSimulationBenchmark(std::span<const std::string_view> args)
+    {
+        const int ticks = ParseIntOr(args, 0, 3600);
+        const uint64_t seed = ParseSeedOr(args, 1, 1);
+        const int enemies = ParseIntOr(args, 2, 110);
+        std::printf("%d ticks of %.4f s, seed %llu, %d enemies, %zu workers\n", ticks, FixedTimestep::TickDuration,
+                    static_cast<unsigned long long>(seed), enemies, JobSystem::DefaultWorkersCount());
+
+        const auto serial = SimulateHeadless(seed, ticks, enemies, false);
+        PrintSimulationResult("serial", serial, ticks);
+        const auto parallel = SimulateHeadless(seed, ticks, enemies, true);
+        PrintSimulationResult("parallel", parallel, ticks);
+
+        const bool passed = serial.hash == parallel.hash;
+        std::printf("final state %016llx, %s\n", static_cast<unsigned long long>(serial.hash),
+                    passed ? "the same in both runs" : "differs between runs");
+        std::printf("%s\n", passed ? "passed" : "FAILED");
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+} // namespace
+
+int RunBenchmark(std::span<const std::string_view> args)
+{
+    if (!args.empty() && args[0] == "generator"sv)
+        return RunGeneratorBenchmark(args.subspan(1));
+    if (!args.empty() && args[0] == "visit"sv)
+        return RunVisitBenchmark(args.subspan(1));
+    if (!args.empty() && args[0] == "simulation"sv)
+        return RunSimulationBenchmark(args.subspan(1));
+
+    std::printf("usage: DeepTankBenchmark generator [layers] [seed] [golden file]\n"
+                "       DeepTankBenchmark visit [passes] [seed]\n"
+                "       DeepTankBenchmark simulation [ticks] [seed] [enemies]\n");
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Console benchmarks: DeepTankBenchmark <name> [arguments]
+int RunBenchmark(std::span<const std::string_view> args);
@@ -0,0 +1,42 @@
+#pragma once
+
+class CancellationToken
+{
+public:
+    CancellationToken() = default;
+
+    bool isCancelled() const { return flag && flag->load(std::memory_order_relaxed); }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(std::shared_ptr<const std::atomic<bool>> flag) : flag{std::move(flag)} {}
+
+    std::shared_ptr<const std::atomic<bool>> flag;
+};
+
+// Owner side of the token. Dropping the source abandons the work, so pending results never have to be waited for
+class CancellationSource
+{
+public:
+    CancellationSource() : flag{std::make_shared<std::atomic<bool>>(false)} {}
+    ~CancellationSource() { cancel(); }
+
+    CancellationSource(CancellationSource &&other) noexcept = default;
+    CancellationSource &operator=(CancellationSource &&other) noexcept
+    {
+        cancel();
+        flag = std::move(other.flag);
+        return *this;
+    }
+
+    void cancel()
+    {
+        if (flag)
+            flag->store(true, std::memory_order_relaxed);
+    }
+
+    CancellationToken getToken() const { return CancellationToken{flag}; }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
@@ -0,0 +1,45 @@
+#include "stdafx.h"
+
+#include "CrowdGrid.h"
+
+static_assert((CrowdGrid::BucketsCount & (CrowdGrid::BucketsCount - 1)) == 0);
+
+glm::ivec3 CrowdGrid::CellOf(glm::vec3 position)
+{
+    return {static_cast<int>(std::floor(position.x / CellSize)), static_cast<int>(std::floor(position.y / CellSize)),
+            static_cast<int>(std::floor(position.z))};
+}
+
+size_t CrowdGrid::BucketOf(glm::ivec3 cell)
+{
+    const auto hash = static_cast<uint32_t>(cell.x) * 73856093u ^ static_cast<uint32_t>(cell.y) * 19349663u ^
+                      static_cast<uint32_t>(cell.z) * 83492791u;
+    return hash & (BucketsCount - 1);
+}
+
+void CrowdGrid::add(glm::vec3 position, float size, ActorKind kind, SlotHandle handle)
+{
+    members.push_back({xy(position), size, MaskOf(kind), handle, CellOf(position)});
+}
+
+void CrowdGrid::build()
+{
+    std::ranges::fill(bucketStarts, 0);
+    maxSize = 0.0f;
+    for (const auto &member : members)
+    {
+        ++bucketStarts[BucketOf(member.cell) + 1];
+        maxSize = std::max(maxSize, member.size);
+    }
+
+    for (size_t bucket = 1; bucket <= BucketsCount; ++bucket)
+        bucketStarts[bucket] += bucketStarts[bucket - 1];
+
+    // filled from the start of every bucket, which leaves bucketStarts[b] at the start of bucket b + 1
+    sorted.resize(members.size());
+    for (const auto &member : members)
+        sorted[bucketStarts[BucketOf(member.cell)]++] = member;
+
+    std::shift_right(bucketStarts.begin(), bucketStarts.end(), 1);
+    bucketStarts[0] = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ActorKind.h"
+#include "SlotMap.h"
+
+// Actors as they were at the start of a tick, for steering against their neighbours. Rebuilt from scratch every tick
+// in two passes: the first counts the actors of every bucket of cells, the second puts them into one array sorted by
+// bucket. Buckets are a fixed hash table of cells, so nothing is allocated once the biggest crowd has been seen
+class CrowdGrid
+{
+public:
+    static constexpr int CellSize = 8;
+    static constexpr size_t BucketsCount = 4096;
+
+    struct Member
+    {
+        glm::vec2 position{0};
+        float size = 0.0f;
+        ActorKindMask kind = 0;
+        SlotHandle handle;
+        glm::ivec3 cell{0}; // buckets are shared by cells, this one tells them apart
+    };
+
+    void clear() { members.clear(); }
+    void add(glm::vec3 position, float size, ActorKind kind, SlotHandle handle);
+    // sorts the added actors, visits see them afterwards
+    void build();
+
+    // visitor(member) gets the actors of the kinds on the layer of the center, floor(z), whose circles touch
+    // the circle. Returning false stops the visit
+    template <typename Visitor>
+    void visit(glm::vec3 center, float radius, ActorKindMask kinds, Visitor &&visitor) const;
+
+private:
+    static glm::ivec3 CellOf(glm::vec3 position);
+    static size_t BucketOf(glm::ivec3 cell);
+
+private:
+    std::vector<Member> members;
+    // members sorted by bucket, bucket b is [bucketStarts[b], bucketStarts[b + 1])
+    std::vector<Member> sorted;
+    std::vector<uint32_t> bucketStarts = std::vector<uint32_t>(BucketsCount + 1);
+    float maxSize = 0.0f;
+};
+
+template <typename Visitor>
+void CrowdGrid::visit(glm::vec3 center, float radius, ActorKindMask kinds, Visitor &&visitor) const
+{
+    const auto reach = radius + maxSize;
+    const auto firstCell = CellOf(center - glm::vec3{reach, reach, 0.0f});
+    const auto lastCell = CellOf(center + glm::vec3{reach, reach, 0.0f});
+    for (auto cy = firstCell.y; cy <= lastCell.y; ++cy)
+    for (auto cx = firstCell.x; cx <= lastCell.x; ++cx)
+    {
+        const auto cell = glm::ivec3{cx, cy, firstCell.z};
+        const auto bucket = BucketOf(cell);
+        for (auto i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i)
+        {
+            const auto &member = sorted[i];
+            const auto offset = member.position - xy(center);
+            const auto touching = radius + member.size;
+            if (dot(offset, offset) <= touching * touching && member.cell == cell && (member.kind & kinds) &&
+                !visitor(member))
+                return;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#include "stdafx.h"
+
+#include "DiscStamp.h"
+
+DiscStamp::DiscStamp(int radius) : radius{radius}, halfWidths(2 * radius + 1)
+{
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        int halfWidth = 0;
+        while ((halfWidth + 1) * (halfWidth + 1) + dy * dy <= radius * radius)
+            ++halfWidth;
+        halfWidths[dy + radius] = halfWidth;
+    }
+}
+
+const DiscStamp &DiscStamp::Get(int radius)
+{
+    if (radius < 0)
+        throw std::logic_error{"disc stamp radius must not be negative"};
+
+    // brushes are used from the main thread mostly, the lock is never contended
+    static std::mutex mutex;
+    static std::vector<std::unique_ptr<DiscStamp>> stamps;
+
+    std::scoped_lock lock{mutex};
+    if (stamps.size() <= static_cast<size_t>(radius))
+        stamps.resize(radius + 1);
+    if (!stamps[radius])
+        stamps[radius].reset(new DiscStamp{radius});
+    return *stamps[radius];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "World.h"
+
+// Tiles within radius of a center, that is dx * dx + dy * dy <= radius * radius, as one span per row.
+// Built once per radius, so brushes cost a clipped span loop per row instead of a distance test per tile
+class DiscStamp
+{
+public:
+    // stamps are kept for the lifetime of the program
+    static const DiscStamp &Get(int radius);
+
+    int getRadius() const { return radius; }
+    // row dy of the disc covers [-halfWidth, halfWidth], -radius <= dy <= radius
+    int getHalfWidth(int dy) const { return halfWidths[dy + radius]; }
+
+    // visitor(rowStart, classes, strengths) gets the loaded parts of the disc rows around the center,
+    // changes become one dirty rectangle of the layer, see LevelLayer::visitRows
+    template <typename Visitor>
+    void apply(LevelLayer &layer, glm::ivec2 center, Visitor &&visitor) const;
+
+private:
+    explicit DiscStamp(int radius);
+
+private:
+    int radius = 0;
+    std::vector<int> halfWidths;
+};
+
+template <typename Visitor>
+void DiscStamp::apply(LevelLayer &layer, glm::ivec2 center, Visitor &&visitor) const
+{
+    layer.visitRows(center - radius, center + radius + 1,
+                    [&](glm::ivec2 rowStart, std::span<TileClassId> classes, std::span<int16_t> strengths)
+    {
+        const auto halfWidth = getHalfWidth(rowStart.y - center.y);
+        const auto from = std::max(center.x - halfWidth - rowStart.x, 0);
+        const auto to = std::min(center.x + halfWidth + 1 - rowStart.x, static_cast<int>(classes.size()));
+        if (from >= to)
+            return;
+
+        const auto width = static_cast<size_t>(to - from);
+        visitor(rowStart + glm::ivec2{from, 0}, classes.subspan(from, width), strengths.subspan(from, width));
+    });
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Turns frame times into a whole number of fixed ticks, so that the simulation doesn't depend on the frame rate.
+// The time left over is the interpolation between the last two ticks for drawing
+class FixedTimestep
+{
+public:
+    static constexpr float TickDuration = 1.0f / 60.0f;
+    // ticks a single frame may catch up, time beyond that is dropped and the game slows down instead of stalling
+    static constexpr int MaxCatchUpTicks = 8;
+
+    // calls tick(TickDuration) for every whole tick of the accumulated time, returns how many times it did
+    template <typename Tick>
+    int advance(float frameTime, Tick &&tick)
+    {
+        accumulator += std::max(frameTime, 0.0f);
+
+        int ticks = 0;
+        for (; accumulator >= TickDuration && ticks < MaxCatchUpTicks; ++ticks)
+        {
+            tick(TickDuration);
+            accumulator -= TickDuration;
+        }
+
+        if (accumulator >= TickDuration)
+            accumulator = std::fmod(accumulator, TickDuration);
+
+        tickCount += ticks;
+        return ticks;
+    }
+
+    // 0 right after a tick, close to 1 right before the next one
+    float getInterpolation() const { return accumulator / TickDuration; }
+    uint64_t getTickCount() const { return tickCount; }
+
+private:
+    float accumulator = 0.0f;
+    uint64_t tickCount = 0;
+};
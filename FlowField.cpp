@@ -0,0 +1,200 @@
+#include "stdafx.h"
+
+#include "FlowField.h"
+#include "World.h"
+
+namespace
+{
+    using glm::ivec2;
+    constexpr std::array Sides{ivec2{1, 0}, ivec2{-1, 0}, ivec2{0, 1}, ivec2{0, -1}};
+    constexpr std::array Corners{ivec2{1, 1}, ivec2{-1, 1}, ivec2{1, -1}, ivec2{-1, -1}};
+} // namespace
+
+FlowField::FlowField() : walkable(Size * Size), buildDistances(Size * Size)
+{
+    queue.reserve(Size * Size);
+}
+
+void FlowField::update(const World &world, glm::vec3 targetPosition)
+{
+    const auto targetCell = glm::ivec3{targetPosition};
+    if (targetCell != wantedTarget)
+    {
+        wantedTarget = targetCell;
+        stale = true;
+    }
+    else if (!stale && wasAreaChanged(world))
+        stale = true;
+
+    if (stale && !building)
+        startBuild(world);
+
+    if (building && continueBuild(world, CellsPerUpdate))
+    {
+        building = false;
+        target = buildTarget;
+        origin = xy(buildTarget) - Radius;
+        distances.swap(buildDistances);
+        if (buildDistances.empty())
+            buildDistances.resize(Size * Size);
+    }
+}
+
+std::optional<glm::vec2> FlowField::getDirection(glm::vec3 position) const
+{
+    const auto cell = xy(glm::ivec3{position}) - origin;
+    if (distances.empty() || static_cast<int>(position.z) != target.z || !IsInside(cell))
+        return std::nullopt;
+
+    const auto distance = distances[IndexOf(cell)];
+    if (distance == Unreachable)
+        return std::nullopt;
+    if (distance == 0)
+        return glm::vec2{0.0f};
+
+    auto isOpen = [&](glm::ivec2 other) { return IsInside(other) && distances[IndexOf(other)] != Unreachable; };
+
+    // a side is always one step nearer, a corner is two steps nearer when both sides next to it are open.
+    // Stepping over a corner with a wall beside it would scrape the wall
+    auto next = cell;
+    auto nextDistance = distance;
+    for (const auto side : Sides)
+    {
+        if (isOpen(cell + side) && distances[IndexOf(cell + side)] < nextDistance)
+        {
+            next = cell + side;
+            nextDistance = distances[IndexOf(next)];
+        }
+    }
+    for (const auto corner : Corners)
+    {
+        if (isOpen(cell + glm::ivec2{corner.x, 0}) && isOpen(cell + glm::ivec2{0, corner.y}) &&
+            isOpen(cell + corner) && distances[IndexOf(cell + corner)] < nextDistance)
+        {
+            next = cell + corner;
+            nextDistance = distances[IndexOf(next)];
+        }
+    }
+
+    return glm::vec2{origin + next} + 0.5f - xy(position);
+}
+
+bool FlowField::wasAreaChanged(const World &world)
+{
+    const auto from = xy(buildTarget) - Radius, to = from + Size;
+    bool changed = false;
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto *layer = world.getLayer(buildTarget.z + i);
+        if (!layer)
+            return true;
+        if (layer->getRevision() == revisions[i])
+            continue;
+
+        const auto rects = layer->getDirtyRectsSince(revisions[i]);
+        if (!rects)
+            return true;
+        for (const auto &rect : *rects)
+        {
+            if (all(lessThan(rect.from, to)) && all(lessThan(from, rect.to)))
+                return true;
+        }
+        changed = true;
+    }
+
+    // chunk loads and unloads aren't logged
+    if (changed && getChunksStamp(world) != chunksStamp)
+        return true;
+
+    // nothing here, the next check starts from now
+    for (int i = 0; i < 2; ++i)
+        revisions[i] = world.getLayer(buildTarget.z + i)->getRevision();
+    return false;
+}
+
+uint64_t FlowField::getChunksStamp(const World &world) const
+{
+    const auto firstChunk = LevelLayer::ChunkOf(xy(buildTarget) - Radius);
+    const auto lastChunk = LevelLayer::ChunkOf(xy(buildTarget) + Radius - 1);
+
+    uint64_t stamp = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto *layer = world.getLayer(buildTarget.z + i);
+        for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+        for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+            stamp = (stamp ^ (layer ? layer->getChunkLoadRevision({cx, cy}) : 0)) * 0x100000001b3ull;
+    }
+    return stamp;
+}
+
+void FlowField::startBuild(const World &world)
+{
+    buildTarget = wantedTarget;
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto *layer = world.getLayer(buildTarget.z + i);
+        revisions[i] = layer ? layer->getRevision() : 0;
+    }
+    chunksStamp = getChunksStamp(world);
+
+    stale = false;
+    building = true;
+    classifiedRows = 0;
+    queue.clear();
+    queueHead = 0;
+}
+
+bool FlowField::continueBuild(const World &world, size_t budget)
+{
+    const auto buildOrigin = xy(buildTarget) - Radius;
+
+    // walkable cells first, a row at a time
+    for (; classifiedRows < Size && budget >= Size; ++classifiedRows, budget -= Size)
+    {
+        std::array<glm::ivec3, Size> points;
+        std::array<World::CellType, Size> cells;
+        for (int x = 0; x < Size; ++x)
+            points[x] = {buildOrigin.x + x, buildOrigin.y + classifiedRows, buildTarget.z};
+        world.categorizeTiles(points, cells);
+
+        for (int x = 0; x < Size; ++x)
+        {
+            const auto index = IndexOf({x, classifiedRows});
+            walkable[index] = cells[x] == World::CellType::Floor;
+            buildDistances[index] = Unreachable;
+        }
+    }
+    if (classifiedRows < Size)
+        return false;
+
+    // the target's cell counts even when the target is falling or standing in a wall
+    if (queue.empty())
+    {
+        const auto start = IndexOf({Radius, Radius});
+        buildDistances[start] = 0;
+        queue.push_back(static_cast<uint32_t>(start));
+    }
+
+    for (; queueHead < queue.size() && budget > 0; ++queueHead, --budget)
+    {
+        const auto index = queue[queueHead];
+        const auto cell = glm::ivec2{static_cast<int>(index % Size), static_cast<int>(index / Size)};
+        const auto distance = static_cast<uint16_t>(buildDistances[index] + 1);
+        for (const auto side : Sides)
+        {
+            const auto next = cell + side;
+            if (!IsInside(next))
+                continue;
+
+            const auto nextIndex = IndexOf(next);
+            if (walkable[nextIndex] && buildDistances[nextIndex] == Unreachable)
+            {
+                buildDistances[nextIndex] = distance;
+                queue.push_back(static_cast<uint32_t>(nextIndex));
+            }
+        }
+    }
+
+    return queueHead == queue.size();
+}
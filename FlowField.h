@@ -0,0 +1,64 @@
+#pragma once
+
+class World;
+
+// Steps to a target over the floor of its layer, for any number of chasers at once. Distances are counted by a
+// breadth first search from the target over the walkable cells of a square around it. The search is spread over
+// ticks: chasers read the last finished field while the next one is built, which starts when the target changes
+// its cell or tiles of the square change
+class FlowField
+{
+public:
+    // the square is [target - Radius, target + Radius) on the layer of the target
+    static constexpr int Radius = 96;
+    static constexpr int Size = 2 * Radius;
+    // cells classified or searched per update, a whole field takes a few ticks
+    static constexpr size_t CellsPerUpdate = 16384;
+
+    FlowField();
+
+    // one tick of the building, the target is taken at its position
+    void update(const World &world, glm::vec3 targetPosition);
+
+    // Towards the center of the next cell on the way, the zero vector in the target's cell. Nothing outside of the
+    // finished field, on other layers and where the target can't be reached from
+    std::optional<glm::vec2> getDirection(glm::vec3 position) const;
+
+    bool isReady() const { return !distances.empty(); }
+
+private:
+    static constexpr uint16_t Unreachable = std::numeric_limits<uint16_t>::max();
+
+    static size_t IndexOf(glm::ivec2 cell) { return static_cast<size_t>(cell.y) * Size + cell.x; }
+    static bool IsInside(glm::ivec2 cell) { return cell.x >= 0 && cell.y >= 0 && cell.x < Size && cell.y < Size; }
+
+    // whether tiles of the square around the build target changed since the build started
+    bool wasAreaChanged(const World &world);
+    uint64_t getChunksStamp(const World &world) const;
+
+    void startBuild(const World &world);
+    // true once the field is done
+    bool continueBuild(const World &world, size_t budget);
+
+private:
+    // finished field of target, distances are indexed by cells relative to origin
+    glm::ivec3 target{0};
+    glm::ivec2 origin{0};
+    std::vector<uint16_t> distances;
+
+    // where the target is now, the field is built again once the current build is done
+    glm::ivec3 wantedTarget{std::numeric_limits<int>::min()};
+    bool stale = false;
+
+    // the field being built
+    glm::ivec3 buildTarget{0};
+    std::array<size_t, 2> revisions{}; // of the target's layer and the one beneath it when the build started
+    uint64_t chunksStamp = 0;
+    bool building = false;
+
+    int classifiedRows = 0;
+    std::vector<uint8_t> walkable;
+    std::vector<uint16_t> buildDistances;
+    std::vector<uint32_t> queue;
+    size_t queueHead = 0;
+};
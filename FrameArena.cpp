@@ -0,0 +1,40 @@
+#include "stdafx.h"
+#include "FrameArena.h"
+
+#include <bit>
+
+FrameArena::FrameArena(size_t initialCapacity)
+    : block{std::make_unique<std::byte[]>(initialCapacity)}, capacity{initialCapacity}
+{
+}
+
+void FrameArena::reset()
+{
+    if (overflowed)
+    {
+        // alignment padding isn't counted in used, the doubling covers it
+        capacity = std::max(capacity * 2, std::bit_ceil(used));
+        block = std::make_unique<std::byte[]>(capacity);
+        overflow.release();
+        overflowed = false;
+    }
+
+    offset = 0;
+    used = 0;
+}
+
+void *FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    used += bytes;
+
+    void *pointer = block.get() + offset;
+    auto space = capacity - offset;
+    if (std::align(alignment, bytes, pointer, space))
+    {
+        offset = capacity - space + bytes;
+        return pointer;
+    }
+
+    overflowed = true;
+    return overflow.allocate(bytes, alignment);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Scratch memory of one tick or frame. Allocations bump an offset in one block, deallocations do nothing and reset
+// drops everything at once. What doesn't fit comes from the heap until the reset, which then grows the block,
+// so a steady workload stops allocating after a few frames. Not thread safe, every thread needs its own arena
+class FrameArena final : public std::pmr::memory_resource
+{
+public:
+    explicit FrameArena(size_t initialCapacity = 64 * 1024);
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    // whatever was allocated since the last reset must not be used anymore
+    void reset();
+
+    size_t getCapacity() const { return capacity; }
+    // bytes asked for since the last reset, in the block or not
+    size_t getUsed() const { return used; }
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+    std::unique_ptr<std::byte[]> block;
+    size_t capacity = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    bool overflowed = false;
+    std::pmr::monotonic_buffer_resource overflow{std::pmr::new_delete_resource()};
+};
@@ -0,0 +1,211 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+
+#include <cstdio>
+
+size_t JobSystem::DefaultWorkersCount()
+{
+    // one core is left for the main thread
+    const auto hardwareThreads = static_cast<size_t>(std::thread::hardware_concurrency());
+    return std::max<size_t>(1, hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+}
+
+JobSystem::JobSystem(size_t numWorkers)
+{
+    numWorkers = std::max<size_t>(1, numWorkers);
+
+    queues.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i)
+        queues.push_back(std::make_unique<WorkerQueue>());
+
+    workers.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard lock{wakeMutex};
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void JobSystem::submit(Job job, int priority)
+{
+    const auto sequence = nextSequence++;
+    auto &queue = *queues[sequence % queues.size()];
+
+    // counted before any worker can see the job, so that popping it never takes the counter below zero
+    {
+        std::lock_guard lock{wakeMutex};
+        pendingJobs++;
+    }
+
+    {
+        std::lock_guard lock{queue.mutex};
+        queue.heap.push_back(QueuedJob{std::move(job), priority, sequence, Clock::now()});
+        std::push_heap(queue.heap.begin(), queue.heap.end());
+    }
+    wakeCondition.notify_one();
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t index)> &body, int priority)
+{
+    struct SharedState
+    {
+        std::atomic<size_t> nextIndex = 0;
+        std::atomic<size_t> doneCount = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error; // the first one, rethrown on the calling thread
+    };
+
+    auto state = std::make_shared<SharedState>();
+
+    // late helpers find no free indices and never touch the body, so it is fine to capture it by reference
+    auto work = [state, count, &body]() {
+        for (size_t index; (index = state->nextIndex++) < count;)
+        {
+            // a failed index still counts as done, or the caller would wait for it forever
+            try
+            {
+                body(index);
+            }
+            catch (...)
+            {
+                std::lock_guard lock{state->mutex};
+                if (!state->error)
+                    state->error = std::current_exception();
+            }
+
+            if (++state->doneCount == count)
+            {
+                std::lock_guard lock{state->mutex};
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    const auto helpersCount = std::min(workers.size(), count > 0 ? count - 1 : 0);
+    for (size_t i = 0; i < helpersCount; ++i)
+        submit(work, priority);
+
+    work();
+
+    std::unique_lock lock{state->mutex};
+    state->finished.wait(lock, [&] { return state->doneCount == count; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+JobSystem::Stats JobSystem::getStats() const
+{
+    Stats stats;
+    stats.queuedJobs = pendingJobs;
+    stats.runningJobs = runningJobs;
+
+    std::lock_guard lock{statsMutex};
+    stats.completedJobs = completedJobs;
+    stats.lastLatency = lastLatency;
+    stats.maxLatency = maxLatency;
+    if (completedJobs > 0)
+        stats.averageLatency = totalLatency / completedJobs;
+
+    return stats;
+}
+
+bool JobSystem::tryPopFrom(WorkerQueue &queue, QueuedJob &result)
+{
+    std::lock_guard lock{queue.mutex};
+    if (queue.heap.empty())
+        return false;
+
+    std::pop_heap(queue.heap.begin(), queue.heap.end());
+    result = std::move(queue.heap.back());
+    queue.heap.pop_back();
+    return true;
+}
+
+bool JobSystem::tryPop(size_t workerIndex, QueuedJob &result)
+{
+    // The most urgent job of the pool is at the top of one of the heaps, the own one wins ties.
+    // Once the chosen top is taken by someone else, the next one of that heap or of another is the most urgent
+    for (;;)
+    {
+        WorkerQueue *mostUrgent = nullptr;
+        std::pair<int, uint64_t> mostUrgentKey;
+        for (size_t offset = 0; offset < queues.size(); ++offset)
+        {
+            auto &queue = *queues[(workerIndex + offset) % queues.size()];
+            std::lock_guard lock{queue.mutex};
+            if (queue.heap.empty())
+                continue;
+
+            const auto &top = queue.heap.front();
+            const auto key = std::pair{top.priority, top.sequence};
+            if (!mostUrgent || key < mostUrgentKey)
+            {
+                mostUrgent = &queue;
+                mostUrgentKey = key;
+            }
+        }
+
+        if (!mostUrgent)
+            return false;
+        if (tryPopFrom(*mostUrgent, result))
+            return true;
+    }
+}
+
+void JobSystem::onJobCompleted(const QueuedJob &job)
+{
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - job.submitTime);
+
+    std::lock_guard lock{statsMutex};
+    completedJobs++;
+    lastLatency = latency;
+    totalLatency += latency;
+    maxLatency = std::max(maxLatency, latency);
+}
+
+void JobSystem::workerLoop(size_t workerIndex)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock lock{wakeMutex};
+            wakeCondition.wait(lock, [this] { return stopping || pendingJobs > 0; });
+            if (stopping)
+                return;
+        }
+
+        QueuedJob job;
+        if (!tryPop(workerIndex, job))
+            continue;
+
+        // only after the pop, see submit
+        pendingJobs--;
+        runningJobs++;
+        // jobs report their own failures, one that doesn't must not take the worker and the program with it
+        try
+        {
+            job.job();
+        }
+        catch (const std::exception &error)
+        {
+            std::fprintf(stderr, "job failed: %s\n", error.what());
+        }
+        catch (...)
+        {
+            std::fprintf(stderr, "job failed\n");
+        }
+        runningJobs--;
+
+        onJobCompleted(job);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Fixed pool of workers with per-worker priority queues. Every worker takes the most urgent job of the whole pool,
+// comparing the tops of all of the queues
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        size_t queuedJobs = 0;
+        size_t runningJobs = 0;
+        size_t completedJobs = 0;
+
+        // time between submission and completion
+        std::chrono::microseconds lastLatency{0};
+        std::chrono::microseconds averageLatency{0};
+        std::chrono::microseconds maxLatency{0};
+    };
+
+public:
+    explicit JobSystem(size_t numWorkers = DefaultWorkersCount());
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // lower priority value is executed earlier
+    void submit(Job job, int priority = 0);
+
+    // Runs body(0..count-1) on the calling thread and on idle workers, returns when all indices are done.
+    // Safe to call from a job: the caller never waits for an index nobody has taken.
+    // The first exception of the body is rethrown once every index is done
+    void parallelFor(size_t count, const std::function<void(size_t index)> &body, int priority = 0);
+
+    size_t getWorkersCount() const { return workers.size(); }
+    Stats getStats() const;
+
+    static size_t DefaultWorkersCount();
+
+private:
+    struct QueuedJob
+    {
+        Job job;
+        int priority = 0;
+        uint64_t sequence = 0;
+        Clock::time_point submitTime;
+
+        // std heap is a max-heap, so the "greatest" job is the most urgent one
+        bool operator<(const QueuedJob &other) const
+        {
+            return priority != other.priority ? priority > other.priority : sequence > other.sequence;
+        }
+    };
+
+    struct WorkerQueue
+    {
+        mutable std::mutex mutex;
+        std::vector<QueuedJob> heap;
+    };
+
+    void workerLoop(size_t workerIndex);
+    bool tryPop(size_t workerIndex, QueuedJob &result);
+    bool tryPopFrom(WorkerQueue &queue, QueuedJob &result);
+    void onJobCompleted(const QueuedJob &job);
+
+private:
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    bool stopping = false;
+
+    std::atomic<size_t> pendingJobs = 0;
+    std::atomic<size_t> runningJobs = 0;
+    std::atomic<uint64_t> nextSequence = 0;
+
+    mutable std::mutex statsMutex;
+    size_t completedJobs = 0;
+    std::chrono::microseconds lastLatency{0}, totalLatency{0}, maxLatency{0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+// Lock-free multiple producers / single consumer queue (D. Vyukov's node based algorithm).
+// push() may be called from any thread, pop() only from the owning one.
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : head{new Node}, tail{head.load(std::memory_order_relaxed)} {}
+
+    ~MpscQueue()
+    {
+        while (pop())
+        {
+        }
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        auto *node = new Node;
+        node->value.emplace(std::move(value));
+
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // returns nothing while the queue is empty or the latest push is not published yet
+    std::optional<T> pop()
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return std::nullopt;
+
+        std::optional<T> result = std::move(next->value);
+        next->value.reset();
+
+        delete tail;
+        tail = next;
+        return result;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next = nullptr;
+        std::optional<T> value;
+    };
+
+    std::atomic<Node *> head;
+    Node *tail;
+};
@@ -0,0 +1,593 @@
+#include "stdafx.h"
+#include "NoiseKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NOISE_KERNEL_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define NOISE_KERNEL_AVX2
+#else
+#include <immintrin.h>
+#define NOISE_KERNEL_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    // constants of libnoise's noisegen.cpp
+    constexpr uint32_t XNoiseGen = 1619;
+    constexpr uint32_t YNoiseGen = 31337;
+    constexpr uint32_t ZNoiseGen = 6971;
+    constexpr uint32_t SeedNoiseGen = 1013;
+    constexpr int ShiftNoiseGen = 8;
+
+    constexpr double GradientScale = 2.12;
+    constexpr double Int32Range = 1073741824.0;
+
+    uint32_t LatticeHash(int ix, int iy, int iz, int seed)
+    {
+        const uint32_t hash = XNoiseGen * static_cast<uint32_t>(ix) + YNoiseGen * static_cast<uint32_t>(iy) +
+                              ZNoiseGen * static_cast<uint32_t>(iz) + SeedNoiseGen * static_cast<uint32_t>(seed);
+        return (hash ^ (hash >> ShiftNoiseGen)) & 0xff;
+    }
+
+    int LatticeFloor(double value) { return value > 0.0 ? static_cast<int>(value) : static_cast<int>(value) - 1; }
+
+    double SCurve3(double a) { return (a * a * (3.0 - 2.0 * a)); }
+
+    double LinearInterp(double n0, double n1, double a) { return ((1.0 - a) * n0) + (a * n1); }
+
+    bool CpuSupportsAvx2()
+    {
+#if defined(NOISE_KERNEL_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        __cpuid(info, 1);
+        const bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+        const bool hasAvx = (info[2] & (1 << 28)) != 0;
+        if (!osUsesXSave || !hasAvx || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif defined(NOISE_KERNEL_X86)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+    // x multipliers of every octave grow, the others are scalars and checked per call
+    bool FitsInt32Range(std::span<const double> xs, double frequency, double lacunarity, int octaveCount)
+    {
+        double maxAbs = 0.0;
+        for (auto x : xs)
+            maxAbs = std::max(maxAbs, std::abs(x));
+
+        double scale = std::abs(frequency);
+        for (int octave = 1; octave < octaveCount; ++octave)
+            scale *= std::abs(lacunarity);
+
+        return maxAbs * scale < Int32Range;
+    }
+
+    std::array<double, 30> CalcSpectralWeights(double lacunarity)
+    {
+        // same as RidgedMulti::CalcSpectralWeights
+        std::array<double, 30> weights{};
+        const double h = 1.0;
+        double frequency = 1.0;
+        for (auto &weight : weights)
+        {
+            weight = pow(frequency, -h);
+            frequency *= lacunarity;
+        }
+        return weights;
+    }
+} // namespace
+
+NoiseKernel::PerlinParams NoiseKernel::PerlinParams::From(const noise::module::Perlin &module)
+{
+    if (module.GetNoiseQuality() != noise::QUALITY_STD)
+        throw std::logic_error{"noise kernel supports only QUALITY_STD"};
+
+    return {module.GetFrequency(), module.GetLacunarity(), module.GetPersistence(), module.GetOctaveCount(),
+            module.GetSeed()};
+}
+
+NoiseKernel::RidgedMultiParams NoiseKernel::RidgedMultiParams::From(const noise::module::RidgedMulti &module)
+{
+    if (module.GetNoiseQuality() != noise::QUALITY_STD)
+        throw std::logic_error{"noise kernel supports only QUALITY_STD"};
+
+    return {module.GetFrequency(), module.GetLacunarity(), module.GetOctaveCount(), module.GetSeed()};
+}
+
+const NoiseKernel &NoiseKernel::Instance()
+{
+    static const NoiseKernel kernel;
+    return kernel;
+}
+
+NoiseKernel::NoiseKernel()
+{
+    // Find a lattice point for every table index and probe its gradient along each axis:
+    // GradientNoise3D(ix + 1, 0, 0, ix, 0, 0) == gradient.x * 2.12 and so on
+    std::array<bool, 256> found{};
+    size_t numFound = 0;
+    for (int ix = 0; numFound < found.size() && ix < (1 << 20); ++ix)
+    {
+        const auto index = LatticeHash(ix, 0, 0, 0);
+        if (found[index])
+            continue;
+
+        const auto x = static_cast<double>(ix);
+        gradients[index * 4 + 0] = noise::GradientNoise3D(x + 1.0, 0.0, 0.0, ix, 0, 0, 0) / GradientScale;
+        gradients[index * 4 + 1] = noise::GradientNoise3D(x, 1.0, 0.0, ix, 0, 0, 0) / GradientScale;
+        gradients[index * 4 + 2] = noise::GradientNoise3D(x, 0.0, 1.0, ix, 0, 0, 0) / GradientScale;
+
+        found[index] = true;
+        numFound++;
+    }
+
+    useAvx2 = numFound == found.size() && CpuSupportsAvx2();
+
+    if (numFound == found.size())
+        selfCheck();
+}
+
+void NoiseKernel::selfCheck()
+{
+    std::mt19937 random{42};
+    std::uniform_real_distribution<double> coordinate{-300.0, 300.0};
+
+    noise::module::Perlin perlinModule;
+    noise::module::RidgedMulti ridgedModule;
+    ridgedModule.SetOctaveCount(4);
+    ridgedModule.SetSeed(7);
+
+    const auto perlinParams = PerlinParams::From(perlinModule);
+    const auto ridgedParams = RidgedMultiParams::From(ridgedModule);
+
+    std::array<double, 37> xs{}, perlinRow{}, ridgedRow{};
+    for (int row = 0; row < 16; ++row)
+    {
+        std::ranges::generate(xs, [&] { return coordinate(random); });
+        const double y = coordinate(random), z = coordinate(random);
+
+        perlin(perlinParams, xs, y, z, perlinRow);
+        ridgedMulti(ridgedParams, xs, y, z, ridgedRow);
+
+        for (size_t i = 0; i < xs.size(); ++i)
+        {
+            measuredError = std::max(measuredError, std::abs(perlinRow[i] - perlinModule.GetValue(xs[i], y, z)));
+            measuredError = std::max(measuredError, std::abs(ridgedRow[i] - ridgedModule.GetValue(xs[i], y, z)));
+        }
+    }
+
+    accurate = measuredError <= Tolerance;
+}
+
+glm::dvec3 NoiseKernel::getGradient(int ix, int iy, int iz, int seed) const
+{
+    const auto *gradient = &gradients[LatticeHash(ix, iy, iz, seed) * 4];
+    return {gradient[0], gradient[1], gradient[2]};
+}
+
+double NoiseKernel::gradientCoherentNoise(double x, double y, double z, int seed) const
+{
+    const int x0 = LatticeFloor(x), y0 = LatticeFloor(y), z0 = LatticeFloor(z);
+    const int x1 = x0 + 1, y1 = y0 + 1, z1 = z0 + 1;
+
+    const double xs = SCurve3(x - static_cast<double>(x0));
+    const double ys = SCurve3(y - static_cast<double>(y0));
+    const double zs = SCurve3(z - static_cast<double>(z0));
+
+    auto gradientNoise = [&, this](int ix, int iy, int iz) {
+        const auto *gradient = &gradients[LatticeHash(ix, iy, iz, seed) * 4];
+        return ((gradient[0] * (x - static_cast<double>(ix))) + (gradient[1] * (y - static_cast<double>(iy))) +
+                (gradient[2] * (z - static_cast<double>(iz)))) *
+               GradientScale;
+    };
+
+    const double iy0 = LinearInterp(LinearInterp(gradientNoise(x0, y0, z0), gradientNoise(x1, y0, z0), xs),
+                                    LinearInterp(gradientNoise(x0, y1, z0), gradientNoise(x1, y1, z0), xs), ys);
+    const double iy1 = LinearInterp(LinearInterp(gradientNoise(x0, y0, z1), gradientNoise(x1, y0, z1), xs),
+                                    LinearInterp(gradientNoise(x0, y1, z1), gradientNoise(x1, y1, z1), xs), ys);
+    return LinearInterp(iy0, iy1, zs);
+}
+
+double NoiseKernel::perlin(const PerlinParams &params, double x, double y, double z) const
+{
+    double value = 0.0;
+    double curPersistence = 1.0;
+
+    x *= params.frequency;
+    y *= params.frequency;
+    z *= params.frequency;
+
+    for (int octave = 0; octave < params.octaveCount; ++octave)
+    {
+        const int seed = static_cast<int>((params.seed + octave) & 0xffffffff);
+        const double signal = gradientCoherentNoise(noise::MakeInt32Range(x), noise::MakeInt32Range(y),
+                                                    noise::MakeInt32Range(z), seed);
+        value += signal * curPersistence;
+
+        x *= params.lacunarity;
+        y *= params.lacunarity;
+        z *= params.lacunarity;
+        curPersistence *= params.persistence;
+    }
+
+    return value;
+}
+
+double NoiseKernel::ridgedMulti(const RidgedMultiParams &params, double x, double y, double z) const
+{
+    const auto spectralWeights = CalcSpectralWeights(params.lacunarity);
+    const double offset = 1.0, gain = 2.0;
+
+    double value = 0.0;
+    double weight = 1.0;
+
+    x *= params.frequency;
+    y *= params.frequency;
+    z *= params.frequency;
+
+    for (int octave = 0; octave < params.octaveCount; ++octave)
+    {
+        const int seed = (params.seed + octave) & 0x7fffffff;
+        double signal = gradientCoherentNoise(noise::MakeInt32Range(x), noise::MakeInt32Range(y),
+                                              noise::MakeInt32Range(z), seed);
+
+        signal = std::abs(signal);
+        signal = offset - signal;
+        signal *= signal;
+        signal *= weight;
+
+        weight = std::clamp(signal * gain, 0.0, 1.0);
+        value += (signal * spectralWeights[octave]);
+
+        x *= params.lacunarity;
+        y *= params.lacunarity;
+        z *= params.lacunarity;
+    }
+
+    return (value * 1.25) - 1.0;
+}
+
+NoiseKernel::PerlinBounds::PerlinBounds(const NoiseKernel &kernel, const PerlinParams &params, glm::dvec2 from,
+                                        glm::dvec2 to, double z):
+    kernel{kernel}, frequency{params.frequency}, lacunarity{params.lacunarity}
+{
+    // a negative weight would need the upper bound of the octave
+    if (params.persistence < 0.0)
+        return;
+
+    double curPersistence = 1.0;
+
+    // same sequence of products as perlin(), so boxes map to the lattice exactly as the samples do
+    from *= params.frequency;
+    to *= params.frequency;
+    z *= params.frequency;
+
+    for (int octave = 0; octave < params.octaveCount; ++octave)
+    {
+        auto &current = octaves.emplace_back();
+        current.seed = static_cast<int>((params.seed + octave) & 0xffffffff);
+        current.weight = curPersistence;
+        current.z = noise::MakeInt32Range(z);
+
+        const auto lo = min(from, to), hi = max(from, to);
+        current.firstCell = {LatticeFloor(lo.x), LatticeFloor(lo.y)};
+        current.columns = LatticeFloor(hi.x) - current.firstCell.x + 1;
+        current.rows = LatticeFloor(hi.y) - current.firstCell.y + 1;
+
+        current.cells.reserve(static_cast<size_t>(current.columns) * current.rows);
+        for (int row = 0; row < current.rows; ++row)
+            for (int column = 0; column < current.columns; ++column)
+                current.cells.push_back(makeCell(current.firstCell + glm::ivec2{column, row}, current.z, current.seed));
+
+        from *= params.lacunarity;
+        to *= params.lacunarity;
+        z *= params.lacunarity;
+        curPersistence *= params.persistence;
+    }
+}
+
+NoiseKernel::PerlinBounds::Cell NoiseKernel::PerlinBounds::makeCell(glm::ivec2 cell, double z, int seed) const
+{
+    const int z0 = LatticeFloor(z);
+    const double zLocal = z - static_cast<double>(z0);
+    const double zs = SCurve3(zLocal);
+
+    // the z interpolation doesn't depend on x and y, so it is folded into the four planes
+    Cell result{};
+    for (int dz = 0; dz <= 1; ++dz)
+    {
+        const double wz = dz ? zs : 1.0 - zs;
+        for (int dy = 0; dy <= 1; ++dy)
+            for (int dx = 0; dx <= 1; ++dx)
+            {
+                const auto gradient = kernel.getGradient(cell.x + dx, cell.y + dy, z0 + dz, seed) * GradientScale;
+                const int corner = dy * 2 + dx;
+                result.offsets[corner] += wz * (gradient.z * (zLocal - dz) - gradient.x * dx - gradient.y * dy);
+                result.slopesX[corner] += wz * gradient.x;
+                result.slopesY[corner] += wz * gradient.y;
+            }
+    }
+    return result;
+}
+
+double NoiseKernel::PerlinBounds::cellLowerBound(const Cell &cell, glm::dvec2 from, glm::dvec2 to)
+{
+    // Every plane is linear, so its minimum over the box is at a box corner. Those minima are blended bilinearly
+    // by the s-curves, so the smallest blend over the box is at one of the four extreme s-curve pairs
+    std::array<double, 4> minima;
+    for (size_t i = 0; i < minima.size(); ++i)
+    {
+        minima[i] = cell.offsets[i] + std::min(cell.slopesX[i] * from.x, cell.slopesX[i] * to.x) +
+                    std::min(cell.slopesY[i] * from.y, cell.slopesY[i] * to.y);
+    }
+
+    const double sxa = SCurve3(from.x), sxb = SCurve3(to.x);
+    const double sya = SCurve3(from.y), syb = SCurve3(to.y);
+    const double atY0[2] = {LinearInterp(minima[0], minima[1], sxa), LinearInterp(minima[0], minima[1], sxb)};
+    const double atY1[2] = {LinearInterp(minima[2], minima[3], sxa), LinearInterp(minima[2], minima[3], sxb)};
+
+    return std::min(std::min(LinearInterp(atY0[0], atY1[0], sya), LinearInterp(atY0[0], atY1[0], syb)),
+                    std::min(LinearInterp(atY0[1], atY1[1], sya), LinearInterp(atY0[1], atY1[1], syb)));
+}
+
+double NoiseKernel::PerlinBounds::lowerBound(glm::dvec2 from, glm::dvec2 to) const
+{
+    if (octaves.empty())
+        return -std::numeric_limits<double>::infinity();
+
+    double bound = 0.0;
+
+    from *= frequency;
+    to *= frequency;
+
+    for (const auto &octave : octaves)
+    {
+        const auto lo = min(from, to), hi = max(from, to);
+        // libnoise wraps coordinates out of this range
+        if (std::max({std::abs(lo.x), std::abs(lo.y), std::abs(hi.x), std::abs(hi.y)}) >= Int32Range)
+            return -std::numeric_limits<double>::infinity();
+
+        const glm::ivec2 firstCell{LatticeFloor(lo.x), LatticeFloor(lo.y)};
+        const glm::ivec2 lastCell{LatticeFloor(hi.x), LatticeFloor(hi.y)};
+
+        double octaveBound = std::numeric_limits<double>::infinity();
+        for (int cellY = firstCell.y; cellY <= lastCell.y; ++cellY)
+            for (int cellX = firstCell.x; cellX <= lastCell.x; ++cellX)
+            {
+                // part of the box inside of the cell, in cell coordinates
+                const glm::dvec2 cellOrigin{cellX, cellY};
+                const auto cellFrom = max(lo, cellOrigin) - cellOrigin;
+                const auto cellTo = min(hi, cellOrigin + 1.0) - cellOrigin;
+
+                const auto index = glm::ivec2{cellX, cellY} - octave.firstCell;
+                // cells outside of the area given to the constructor are made on the fly
+                std::optional<Cell> madeCell;
+                if (index.x < 0 || index.y < 0 || index.x >= octave.columns || index.y >= octave.rows)
+                    madeCell = makeCell({cellX, cellY}, octave.z, octave.seed);
+                const auto &cell = madeCell ? *madeCell : octave.cells[index.y * octave.columns + index.x];
+
+                octaveBound = std::min(octaveBound, cellLowerBound(cell, cellFrom, cellTo));
+            }
+
+        bound += octaveBound * octave.weight;
+
+        from *= lacunarity;
+        to *= lacunarity;
+    }
+
+    return bound;
+}
+
+double NoiseKernel::perlinLowerBound(const PerlinParams &params, glm::dvec2 from, glm::dvec2 to, double z) const
+{
+    return PerlinBounds{*this, params, from, to, z}.lowerBound(from, to);
+}
+
+void NoiseKernel::perlinRowScalar(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                                  std::span<double> result) const
+{
+    for (size_t i = 0; i < xs.size(); ++i)
+        result[i] = perlin(params, xs[i], y, z);
+}
+
+void NoiseKernel::ridgedMultiRowScalar(const RidgedMultiParams &params, std::span<const double> xs, double y,
+                                       double z, std::span<double> result) const
+{
+    for (size_t i = 0; i < xs.size(); ++i)
+        result[i] = ridgedMulti(params, xs[i], y, z);
+}
+
+void NoiseKernel::perlin(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                         std::span<double> result) const
+{
+    assert(xs.size() == result.size());
+
+    if (useAvx2 && FitsInt32Range(xs, params.frequency, params.lacunarity, params.octaveCount))
+        perlinRowAvx2(params, xs, y, z, result);
+    else
+        perlinRowScalar(params, xs, y, z, result);
+}
+
+void NoiseKernel::ridgedMulti(const RidgedMultiParams &params, std::span<const double> xs, double y, double z,
+                              std::span<double> result) const
+{
+    assert(xs.size() == result.size());
+
+    if (useAvx2 && FitsInt32Range(xs, params.frequency, params.lacunarity, params.octaveCount))
+        ridgedMultiRowAvx2(params, xs, y, z, result);
+    else
+        ridgedMultiRowScalar(params, xs, y, z, result);
+}
+
+#if defined(NOISE_KERNEL_X86)
+
+namespace
+{
+    // gradient coherent noise of four x values sharing y and z. Operation order follows libnoise
+    NOISE_KERNEL_AVX2 __m256d GradientCoherentNoise4(const double *gradients, __m256d x, double y, double z,
+                                                     int seed)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d two = _mm256_set1_pd(2.0);
+        const __m256d three = _mm256_set1_pd(3.0);
+        const __m256d scale = _mm256_set1_pd(GradientScale);
+
+        // x0 = x > 0 ? (int)x : (int)x - 1
+        const __m256d truncated = _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        const __m256d notPositive = _mm256_cmp_pd(x, zero, _CMP_LE_OQ);
+        const __m256d x0 = _mm256_sub_pd(truncated, _mm256_and_pd(notPositive, one));
+        const __m256d x1 = _mm256_add_pd(x0, one);
+
+        const int y0 = LatticeFloor(y), z0 = LatticeFloor(z);
+        const int y1 = y0 + 1, z1 = z0 + 1;
+
+        const __m256d fx = _mm256_sub_pd(x, x0);
+        const __m256d xs = _mm256_mul_pd(_mm256_mul_pd(fx, fx), _mm256_sub_pd(three, _mm256_mul_pd(two, fx)));
+        const __m256d ys = _mm256_set1_pd(SCurve3(y - static_cast<double>(y0)));
+        const __m256d zs = _mm256_set1_pd(SCurve3(z - static_cast<double>(z0)));
+
+        const __m256d xPoint0 = _mm256_sub_pd(x, x0), xPoint1 = _mm256_sub_pd(x, x1);
+        const double yPoint0 = y - static_cast<double>(y0), yPoint1 = y - static_cast<double>(y1);
+        const double zPoint0 = z - static_cast<double>(z0), zPoint1 = z - static_cast<double>(z1);
+
+        const __m128i xHash0 = _mm_mullo_epi32(_mm256_cvttpd_epi32(x0), _mm_set1_epi32(static_cast<int>(XNoiseGen)));
+        const __m128i xHash1 = _mm_add_epi32(xHash0, _mm_set1_epi32(static_cast<int>(XNoiseGen)));
+        const uint32_t seedHash = SeedNoiseGen * static_cast<uint32_t>(seed);
+
+        auto gradientNoise = [&](__m128i xHash, __m256d xPoint, int iy, double yPoint, int iz, double zPoint)
+            NOISE_KERNEL_AVX2 {
+            const uint32_t rest = YNoiseGen * static_cast<uint32_t>(iy) + ZNoiseGen * static_cast<uint32_t>(iz) + seedHash;
+            __m128i hash = _mm_add_epi32(xHash, _mm_set1_epi32(static_cast<int>(rest)));
+            hash = _mm_and_si128(_mm_xor_si128(hash, _mm_srli_epi32(hash, ShiftNoiseGen)), _mm_set1_epi32(0xff));
+            const __m128i offsets = _mm_slli_epi32(hash, 2);
+
+            const __m256d gx = _mm256_i32gather_pd(gradients + 0, offsets, 8);
+            const __m256d gy = _mm256_i32gather_pd(gradients + 1, offsets, 8);
+            const __m256d gz = _mm256_i32gather_pd(gradients + 2, offsets, 8);
+
+            const __m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(gx, xPoint), _mm256_mul_pd(gy, _mm256_set1_pd(yPoint))),
+                                              _mm256_mul_pd(gz, _mm256_set1_pd(zPoint)));
+            return _mm256_mul_pd(dot, scale);
+        };
+
+        auto lerp = [&](__m256d n0, __m256d n1, __m256d a) NOISE_KERNEL_AVX2 {
+            return _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(one, a), n0), _mm256_mul_pd(a, n1));
+        };
+
+        __m256d ix0 = lerp(gradientNoise(xHash0, xPoint0, y0, yPoint0, z0, zPoint0),
+                           gradientNoise(xHash1, xPoint1, y0, yPoint0, z0, zPoint0), xs);
+        __m256d ix1 = lerp(gradientNoise(xHash0, xPoint0, y1, yPoint1, z0, zPoint0),
+                           gradientNoise(xHash1, xPoint1, y1, yPoint1, z0, zPoint0), xs);
+        const __m256d iy0 = lerp(ix0, ix1, ys);
+
+        ix0 = lerp(gradientNoise(xHash0, xPoint0, y0, yPoint0, z1, zPoint1),
+                   gradientNoise(xHash1, xPoint1, y0, yPoint0, z1, zPoint1), xs);
+        ix1 = lerp(gradientNoise(xHash0, xPoint0, y1, yPoint1, z1, zPoint1),
+                   gradientNoise(xHash1, xPoint1, y1, yPoint1, z1, zPoint1), xs);
+        const __m256d iy1 = lerp(ix0, ix1, ys);
+
+        return lerp(iy0, iy1, zs);
+    }
+} // namespace
+
+NOISE_KERNEL_AVX2 void NoiseKernel::perlinRowAvx2(const PerlinParams &params, std::span<const double> xs, double y,
+                                                  double z, std::span<double> result) const
+{
+    const size_t vectorizedCount = xs.size() & ~size_t{3};
+    for (size_t i = 0; i < vectorizedCount; i += 4)
+    {
+        __m256d x = _mm256_mul_pd(_mm256_loadu_pd(&xs[i]), _mm256_set1_pd(params.frequency));
+        double octaveY = y * params.frequency, octaveZ = z * params.frequency;
+
+        __m256d value = _mm256_setzero_pd();
+        double curPersistence = 1.0;
+        for (int octave = 0; octave < params.octaveCount; ++octave)
+        {
+            const int seed = static_cast<int>((params.seed + octave) & 0xffffffff);
+            const __m256d signal = GradientCoherentNoise4(gradients.data(), x, noise::MakeInt32Range(octaveY),
+                                                          noise::MakeInt32Range(octaveZ), seed);
+            value = _mm256_add_pd(value, _mm256_mul_pd(signal, _mm256_set1_pd(curPersistence)));
+
+            x = _mm256_mul_pd(x, _mm256_set1_pd(params.lacunarity));
+            octaveY *= params.lacunarity;
+            octaveZ *= params.lacunarity;
+            curPersistence *= params.persistence;
+        }
+
+        _mm256_storeu_pd(&result[i], value);
+    }
+
+    perlinRowScalar(params, xs.subspan(vectorizedCount), y, z, result.subspan(vectorizedCount));
+}
+
+NOISE_KERNEL_AVX2 void NoiseKernel::ridgedMultiRowAvx2(const RidgedMultiParams &params, std::span<const double> xs,
+                                                       double y, double z, std::span<double> result) const
+{
+    const auto spectralWeights = CalcSpectralWeights(params.lacunarity);
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d offset = _mm256_set1_pd(1.0), gain = _mm256_set1_pd(2.0);
+
+    const size_t vectorizedCount = xs.size() & ~size_t{3};
+    for (size_t i = 0; i < vectorizedCount; i += 4)
+    {
+        __m256d x = _mm256_mul_pd(_mm256_loadu_pd(&xs[i]), _mm256_set1_pd(params.frequency));
+        double octaveY = y * params.frequency, octaveZ = z * params.frequency;
+
+        __m256d value = zero;
+        __m256d weight = one;
+        for (int octave = 0; octave < params.octaveCount; ++octave)
+        {
+            const int seed = (params.seed + octave) & 0x7fffffff;
+            __m256d signal = GradientCoherentNoise4(gradients.data(), x, noise::MakeInt32Range(octaveY),
+                                                    noise::MakeInt32Range(octaveZ), seed);
+
+            signal = _mm256_andnot_pd(signMask, signal);
+            signal = _mm256_sub_pd(offset, signal);
+            signal = _mm256_mul_pd(signal, signal);
+            signal = _mm256_mul_pd(signal, weight);
+
+            weight = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(signal, gain), zero), one);
+            value = _mm256_add_pd(value, _mm256_mul_pd(signal, _mm256_set1_pd(spectralWeights[octave])));
+
+            x = _mm256_mul_pd(x, _mm256_set1_pd(params.lacunarity));
+            octaveY *= params.lacunarity;
+            octaveZ *= params.lacunarity;
+        }
+
+        _mm256_storeu_pd(&result[i], _mm256_sub_pd(_mm256_mul_pd(value, _mm256_set1_pd(1.25)), one));
+    }
+
+    ridgedMultiRowScalar(params, xs.subspan(vectorizedCount), y, z, result.subspan(vectorizedCount));
+}
+
+#else
+
+void NoiseKernel::perlinRowAvx2(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                                std::span<double> result) const
+{
+    perlinRowScalar(params, xs, y, z, result);
+}
+
+void NoiseKernel::ridgedMultiRowAvx2(const RidgedMultiParams &params, std::span<const double> xs, double y, double z,
+                                     std::span<double> result) const
+{
+    ridgedMultiRowScalar(params, xs, y, z, result);
+}
+
+#endif
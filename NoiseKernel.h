@@ -0,0 +1,122 @@
+#pragma once
+
+#include <noise/noise.h>
+
+// Row-at-a-time evaluation of libnoise's Perlin and RidgedMulti modules (QUALITY_STD only).
+// Uses AVX2 when the CPU has it and a scalar loop otherwise. libnoise doesn't expose its gradient table,
+// so it is recovered from noise::GradientNoise3D once; that costs up to one ulp per gradient, which is why
+// results agree with libnoise within Tolerance instead of bit for bit. The whole kernel is checked against
+// libnoise on construction, see isAccurate().
+class NoiseKernel
+{
+public:
+    static constexpr double Tolerance = 1e-9;
+
+    struct PerlinParams
+    {
+        double frequency = 1.0;
+        double lacunarity = 2.0;
+        double persistence = 0.5;
+        int octaveCount = 6;
+        int seed = 0;
+
+        static PerlinParams From(const noise::module::Perlin &module);
+    };
+
+    struct RidgedMultiParams
+    {
+        double frequency = 1.0;
+        double lacunarity = 2.0;
+        int octaveCount = 6;
+        int seed = 0;
+
+        static RidgedMultiParams From(const noise::module::RidgedMulti &module);
+    };
+
+public:
+    static const NoiseKernel &Instance();
+
+    bool isAccurate() const { return accurate; }
+    bool isVectorized() const { return useAvx2; }
+
+    // Same as module.GetValue(xs[i], y, z) for every i. xs and result must have the same length
+    void perlin(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                std::span<double> result) const;
+    void ridgedMulti(const RidgedMultiParams &params, std::span<const double> xs, double y, double z,
+                     std::span<double> result) const;
+
+    double perlin(const PerlinParams &params, double x, double y, double z) const;
+    double ridgedMulti(const RidgedMultiParams &params, double x, double y, double z) const;
+
+    // Lower bounds of perlin(params, x, y, z) over boxes of x and y at a fixed z. Inside a lattice cell the noise
+    // is a blend of linear functions with non-negative weights that sum to one, so it can't go below the blend
+    // of their minima over the box. Tighter for smaller boxes, exact for a point up to rounding (well within
+    // Tolerance). Cells of the area given to the constructor are prepared once
+    class PerlinBounds
+    {
+    public:
+        PerlinBounds(const NoiseKernel &kernel, const PerlinParams &params, glm::dvec2 from, glm::dvec2 to, double z);
+
+        // value the noise can't go below for any x in [from.x, to.x] and y in [from.y, to.y]
+        double lowerBound(glm::dvec2 from, glm::dvec2 to) const;
+
+    private:
+        struct Cell
+        {
+            // every corner's gradient function is offset + slopeX * x + slopeY * y inside of the cell,
+            // z interpolation included
+            std::array<double, 4> offsets, slopesX, slopesY;
+        };
+
+        struct Octave
+        {
+            int seed = 0;
+            double weight = 1.0;
+            double z = 0.0;
+            glm::ivec2 firstCell{0};
+            int columns = 0, rows = 0;
+            std::vector<Cell> cells;
+        };
+
+        Cell makeCell(glm::ivec2 cell, double z, int seed) const;
+        static double cellLowerBound(const Cell &cell, glm::dvec2 from, glm::dvec2 to);
+
+    private:
+        const NoiseKernel &kernel;
+        double frequency = 1.0;
+        double lacunarity = 2.0;
+        std::vector<Octave> octaves;
+    };
+
+    // one off PerlinBounds::lowerBound
+    double perlinLowerBound(const PerlinParams &params, glm::dvec2 from, glm::dvec2 to, double z) const;
+
+    // per octave gradient at the lattice point, the same one noise::GradientNoise3D uses
+    glm::dvec3 getGradient(int ix, int iy, int iz, int seed) const;
+
+    // the largest difference from libnoise seen by the self check
+    double getMeasuredError() const { return measuredError; }
+
+private:
+    NoiseKernel();
+
+    double gradientCoherentNoise(double x, double y, double z, int seed) const;
+
+    void perlinRowScalar(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                         std::span<double> result) const;
+    void ridgedMultiRowScalar(const RidgedMultiParams &params, std::span<const double> xs, double y, double z,
+                              std::span<double> result) const;
+    void perlinRowAvx2(const PerlinParams &params, std::span<const double> xs, double y, double z,
+                       std::span<double> result) const;
+    void ridgedMultiRowAvx2(const RidgedMultiParams &params, std::span<const double> xs, double y, double z,
+                            std::span<double> result) const;
+
+    void selfCheck();
+
+private:
+    // x, y, z, padding - the layout of libnoise's table
+    alignas(32) std::array<double, 256 * 4> gradients{};
+    bool useAvx2 = false;
+    bool accurate = false;
+    double measuredError = 0.0;
+};
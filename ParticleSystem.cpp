@@ -0,0 +1,134 @@
+#include "stdafx.h"
+
+#include "ParticleSystem.h"
+#include "World.h"
+
+namespace
+{
+    // values[i] += rates[i] * dt, the loops the update is made of
+    void Integrate(std::span<float> values, std::span<const float> rates, float dt)
+    {
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] += rates[i] * dt;
+    }
+} // namespace
+
+ParticleSystem::ParticleSystem()
+{
+    for (auto *plane : {&positionsX, &positionsY, &depths, &velocitiesX, &velocitiesY, &lifetimes, &initialLifetimes,
+                        &sizes, &sizeVelocities, &angles, &angularVelocities})
+        plane->resize(Capacity);
+    textureIndices.resize(Capacity);
+    projectileIndices.resize(Capacity);
+
+    projectiles.resize(MaxProjectiles);
+    freeProjectiles.reserve(MaxProjectiles);
+    for (size_t i = MaxProjectiles; i-- > 0;)
+        freeProjectiles.push_back(static_cast<uint16_t>(i));
+
+    explosions.reserve(MaxProjectiles);
+}
+
+bool ParticleSystem::spawn(const Particle &particle)
+{
+    if (count == Capacity)
+        return false;
+
+    const auto i = count++;
+    positionsX[i] = particle.position.x;
+    positionsY[i] = particle.position.y;
+    depths[i] = particle.position.z;
+    velocitiesX[i] = particle.velocity.x;
+    velocitiesY[i] = particle.velocity.y;
+    lifetimes[i] = initialLifetimes[i] = particle.lifetime;
+    sizes[i] = particle.size;
+    sizeVelocities[i] = particle.sizeVelocity;
+    angles[i] = 0.0f;
+    angularVelocities[i] = particle.angularVelocity;
+    textureIndices[i] = particle.texture;
+    projectileIndices[i] = NoProjectile;
+    return true;
+}
+
+void ParticleSystem::explode(Particle flash, const Explosion &explosion)
+{
+    flash.position = explosion.position;
+    spawn(flash);
+    explosions.push_back(explosion);
+}
+
+bool ParticleSystem::spawnProjectile(const Particle &particle, const Particle &flash, const Explosion &explosion)
+{
+    if (freeProjectiles.empty() || !spawn(particle))
+        return false;
+
+    const auto index = freeProjectiles.back();
+    freeProjectiles.pop_back();
+    projectiles[index] = {flash, explosion};
+    projectileIndices[count - 1] = index;
+    return true;
+}
+
+void ParticleSystem::update(float dt, const World &world)
+{
+    Integrate({positionsX.data(), count}, velocitiesX, dt);
+    Integrate({positionsY.data(), count}, velocitiesY, dt);
+    Integrate({sizes.data(), count}, sizeVelocities, dt);
+    Integrate({angles.data(), count}, angularVelocities, dt);
+    for (size_t i = 0; i < count; ++i)
+        lifetimes[i] -= dt;
+
+    updateProjectiles(world);
+
+    // erasing moves the last particle into the hole, going backwards checks every one once
+    for (size_t i = count; i-- > 0;)
+    {
+        if (lifetimes[i] <= 0.0f || sizes[i] <= 0.0f)
+            erase(i);
+    }
+}
+
+void ParticleSystem::updateProjectiles(const World &world)
+{
+    // explosions spawn flashes past the end, they aren't projectiles
+    const auto projectilesEnd = count;
+    for (size_t i = 0; i < projectilesEnd; ++i)
+    {
+        if (projectileIndices[i] == NoProjectile || lifetimes[i] <= 0.0f)
+            continue;
+
+        const auto position = glm::vec3{positionsX[i], positionsY[i], depths[i]};
+        if (world.categorizeTile(position) != World::CellType::Wall)
+        {
+            world.queryPoint(position, contacts);
+            if (contacts.empty())
+                continue;
+        }
+
+        lifetimes[i] = 0.0f;
+
+        const auto &projectile = projectiles[projectileIndices[i]];
+        if (projectile.explosion.radius > 0)
+        {
+            auto explosion = projectile.explosion;
+            explosion.position = position;
+            explode(projectile.flash, explosion);
+        }
+    }
+}
+
+void ParticleSystem::erase(size_t index)
+{
+    if (projectileIndices[index] != NoProjectile)
+        freeProjectiles.push_back(projectileIndices[index]);
+
+    const auto last = --count;
+    if (index == last)
+        return;
+
+    for (auto *plane : {&positionsX, &positionsY, &depths, &velocitiesX, &velocitiesY, &lifetimes, &initialLifetimes,
+                        &sizes, &sizeVelocities, &angles, &angularVelocities})
+        (*plane)[index] = (*plane)[last];
+    textureIndices[index] = textureIndices[last];
+    projectileIndices[index] = projectileIndices[last];
+}
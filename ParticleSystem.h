@@ -0,0 +1,96 @@
+#pragma once
+
+#include "SlotMap.h"
+
+class Actor;
+class World;
+
+// Short lived sprites: flashes, explosions and projectiles. They live in parallel arrays of a fixed pool, so firing
+// never allocates and WorldRenderer draws the particles of a layer as one vertex batch per texture.
+// Gameplay reacts to the explosions the particles report instead of to callbacks of single particles
+class ParticleSystem
+{
+public:
+    static constexpr size_t Capacity = 4096;
+    static constexpr size_t MaxProjectiles = 1024;
+
+    struct Particle
+    {
+        glm::vec3 position{0};
+        glm::vec2 velocity{0};
+        float lifetime = 1.0f;
+        float size = 1.0f; // of the longer side of the texture, in tiles
+        float sizeVelocity = 0.0f;
+        float angularVelocity = 0.0f; // degrees per second
+        uint8_t texture = 0; // index of the renderer's particle textures
+    };
+
+    // harvests the tiles of the disc for the gatherer and damages the characters at the center except the gatherer
+    struct Explosion
+    {
+        glm::vec3 position{0};
+        int radius = 0;
+        float gatherForce = 0.0f;
+        float damage = 0.0f;
+        SlotHandle gatherer;
+    };
+
+public:
+    ParticleSystem();
+
+    // false when the pool is full, the particle is dropped then
+    bool spawn(const Particle &particle);
+    // the flash is moved to the explosion, which is reported even when the pool is full
+    void explode(Particle flash, const Explosion &explosion);
+    // the particle stops at walls and at registered actors and explodes there, unless the radius of explosion is 0
+    bool spawnProjectile(const Particle &particle, const Particle &flash, const Explosion &explosion);
+
+    void update(float dt, const World &world);
+
+    // reported since the last clearExplosions
+    std::span<const Explosion> getExplosions() const { return explosions; }
+    void clearExplosions() { explosions.clear(); }
+
+    // the alive particles, index by index
+    size_t getCount() const { return count; }
+    std::span<const float> getPositionsX() const { return {positionsX.data(), count}; }
+    std::span<const float> getPositionsY() const { return {positionsY.data(), count}; }
+    std::span<const float> getDepths() const { return {depths.data(), count}; }
+    std::span<const float> getVelocitiesX() const { return {velocitiesX.data(), count}; }
+    std::span<const float> getVelocitiesY() const { return {velocitiesY.data(), count}; }
+    std::span<const float> getSizes() const { return {sizes.data(), count}; }
+    std::span<const float> getAngles() const { return {angles.data(), count}; }
+    std::span<const uint8_t> getTextures() const { return {textureIndices.data(), count}; }
+    // 1 for new particles, 0 for the ones about to die
+    float getOpacity(size_t index) const { return std::clamp(lifetimes[index] / initialLifetimes[index], 0.0f, 1.0f); }
+
+private:
+    struct Projectile
+    {
+        Particle flash;
+        Explosion explosion;
+    };
+
+    static constexpr uint16_t NoProjectile = std::numeric_limits<uint16_t>::max();
+
+    void updateProjectiles(const World &world);
+    // moves the last particle into the hole
+    void erase(size_t index);
+
+private:
+    size_t count = 0;
+    // Capacity long, the first count are alive
+    std::vector<float> positionsX, positionsY, depths;
+    std::vector<float> velocitiesX, velocitiesY;
+    std::vector<float> lifetimes, initialLifetimes;
+    std::vector<float> sizes, sizeVelocities;
+    std::vector<float> angles, angularVelocities;
+    std::vector<uint8_t> textureIndices;
+    std::vector<uint16_t> projectileIndices;
+
+    std::vector<Projectile> projectiles;
+    std::vector<uint16_t> freeProjectiles;
+
+    std::vector<Explosion> explosions;
+    std::vector<Actor *> contacts;
+};
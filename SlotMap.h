@@ -0,0 +1,98 @@
+#pragma once
+
+// Refers to a value of a SlotMap. The default handle and handles of erased values are never valid again
+struct SlotHandle
+{
+    uint32_t index = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    bool operator==(const SlotHandle &) const = default;
+};
+
+// Values in one dense array, with handles that stay valid until their value is erased.
+// Erasing moves the last value into the hole, so it is O(1) but the order of values changes
+template <typename T>
+class SlotMap
+{
+public:
+    using Handle = SlotHandle;
+
+    Handle insert(T value)
+    {
+        uint32_t index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back({});
+        }
+
+        auto &slot = slots[index];
+        slot.denseIndex = static_cast<uint32_t>(values.size());
+        values.push_back(std::move(value));
+        denseToSlot.push_back(index);
+        return {index, slot.generation};
+    }
+
+    // false for handles that aren't valid
+    bool erase(Handle handle)
+    {
+        if (!contains(handle))
+            return false;
+
+        auto &slot = slots[handle.index];
+        const auto denseIndex = slot.denseIndex;
+        if (denseIndex + 1 != values.size())
+        {
+            values[denseIndex] = std::move(values.back());
+            denseToSlot[denseIndex] = denseToSlot.back();
+            slots[denseToSlot[denseIndex]].denseIndex = denseIndex;
+        }
+        values.pop_back();
+        denseToSlot.pop_back();
+
+        slot.generation++;
+        freeSlots.push_back(handle.index);
+        return true;
+    }
+
+    bool contains(Handle handle) const
+    {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+
+    T *find(Handle handle) { return contains(handle) ? &values[slots[handle.index].denseIndex] : nullptr; }
+    const T *find(Handle handle) const { return const_cast<SlotMap *>(this)->find(handle); }
+
+    // dense values, indices are valid until the next erase
+    size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+    T &operator[](size_t denseIndex) { return values[denseIndex]; }
+    const T &operator[](size_t denseIndex) const { return values[denseIndex]; }
+    Handle getHandle(size_t denseIndex) const
+    {
+        const auto index = denseToSlot[denseIndex];
+        return {index, slots[index].generation};
+    }
+
+    auto begin() { return values.begin(); }
+    auto end() { return values.end(); }
+    auto begin() const { return values.begin(); }
+    auto end() const { return values.end(); }
+
+private:
+    struct Slot
+    {
+        uint32_t denseIndex = 0;
+        uint32_t generation = 1; // 0 is the generation of the default handle
+    };
+
+    std::vector<T> values;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+};
@@ -0,0 +1,114 @@
+#include "stdafx.h"
+
+#include "SpatialGrid.h"
+#include "Actor.h"
+
+glm::ivec3 SpatialGrid::CellOf(glm::vec3 position)
+{
+    return {static_cast<int>(std::floor(position.x / CellSize)), static_cast<int>(std::floor(position.y / CellSize)),
+            static_cast<int>(std::floor(position.z))};
+}
+
+uint64_t SpatialGrid::CellKey(glm::ivec3 cell)
+{
+    // 24 bits of a cell coordinate cover 2^28 tiles, far beyond any layer
+    return (uint64_t{static_cast<uint16_t>(cell.z)} << 48) |
+           (uint64_t{static_cast<uint32_t>(cell.y) & 0xffffff} << 24) | (static_cast<uint32_t>(cell.x) & 0xffffff);
+}
+
+SpatialGrid::Entry SpatialGrid::MakeEntry(Actor *actor)
+{
+    return {actor, xy(actor->getPosition()), static_cast<float>(actor->getSize()), MaskOf(actor->getKind())};
+}
+
+void SpatialGrid::insert(Actor *actor)
+{
+    const auto cell = CellOf(actor->getPosition());
+    if (!actorCells.emplace(actor, cell).second)
+        return;
+
+    const auto entry = MakeEntry(actor);
+    cells[CellKey(cell)].push_back(entry);
+    maxActorSize = std::max(maxActorSize, entry.size);
+}
+
+void SpatialGrid::remove(Actor *actor)
+{
+    const auto found = actorCells.find(actor);
+    if (found == actorCells.end())
+        return;
+
+    const auto bucket = cells.find(CellKey(found->second));
+    std::erase_if(bucket->second, [actor](const Entry &entry) { return entry.actor == actor; });
+    if (bucket->second.empty())
+        cells.erase(bucket);
+
+    actorCells.erase(found);
+}
+
+void SpatialGrid::update(Actor *actor)
+{
+    const auto found = actorCells.find(actor);
+    if (found == actorCells.end())
+        return;
+
+    const auto entry = MakeEntry(actor);
+    maxActorSize = std::max(maxActorSize, entry.size);
+
+    const auto bucket = cells.find(CellKey(found->second));
+    const auto cell = CellOf(actor->getPosition());
+    if (cell == found->second)
+    {
+        *std::ranges::find(bucket->second, actor, &Entry::actor) = entry;
+        return;
+    }
+
+    std::erase_if(bucket->second, [actor](const Entry &other) { return other.actor == actor; });
+    if (bucket->second.empty())
+        cells.erase(bucket);
+
+    cells[CellKey(cell)].push_back(entry);
+    found->second = cell;
+}
+
+template <typename Distance>
+void SpatialGrid::query(int depth, glm::vec2 from, glm::vec2 to, ActorKindMask kinds, std::vector<Actor *> &result,
+                        Distance &&distanceTo) const
+{
+    result.clear();
+
+    const auto firstCell = CellOf({from - maxActorSize, depth});
+    const auto lastCell = CellOf({to + maxActorSize, depth});
+    for (auto cy = firstCell.y; cy <= lastCell.y; ++cy)
+    for (auto cx = firstCell.x; cx <= lastCell.x; ++cx)
+    {
+        const auto bucket = cells.find(CellKey({cx, cy, depth}));
+        if (bucket == cells.end())
+            continue;
+
+        for (const auto &entry : bucket->second)
+        {
+            if ((entry.kind & kinds) && distanceTo(entry.position) <= entry.size)
+                result.push_back(entry.actor);
+        }
+    }
+}
+
+void SpatialGrid::queryPoint(glm::vec3 point, std::vector<Actor *> &result, ActorKindMask kinds) const
+{
+    queryCircle(point, 0.0f, result, kinds);
+}
+
+void SpatialGrid::queryCircle(glm::vec3 center, float radius, std::vector<Actor *> &result, ActorKindMask kinds) const
+{
+    const auto position = xy(center);
+    query(static_cast<int>(std::floor(center.z)), position - radius, position + radius, kinds, result,
+          [=](glm::vec2 actorPosition) { return glm::length(actorPosition - position) - radius; });
+}
+
+void SpatialGrid::queryRect(int depth, glm::vec2 from, glm::vec2 to, std::vector<Actor *> &result,
+                            ActorKindMask kinds) const
+{
+    query(depth, from, to, kinds, result,
+          [=](glm::vec2 actorPosition) { return glm::length(actorPosition - clamp(actorPosition, from, to)); });
+}
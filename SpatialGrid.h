@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ActorKind.h"
+
+class Actor;
+
+// Actors as circles of radius getSize() around their positions, bucketed by layer and by CellSize x CellSize tiles.
+// A query only looks into the cells its shape can reach and writes the hits into the caller's buffer.
+// Positions and sizes are copied on insert and update, so queries don't touch actors that may be moving on other
+// threads and see every actor as of its last update
+class SpatialGrid
+{
+public:
+    static constexpr int CellSize = 16;
+
+    void insert(Actor *actor);
+    void remove(Actor *actor);
+    // takes the current position and size of the actor, actors that aren't in the grid are ignored
+    void update(Actor *actor);
+    bool contains(Actor *actor) const { return actorCells.contains(actor); }
+
+    // Queries overwrite result. Only actors of the kinds in the mask on the layer of the shape, that is floor(z),
+    // are considered. Kinds are checked before the actors are touched
+    // actors whose circle contains the point
+    void queryPoint(glm::vec3 point, std::vector<Actor *> &result, ActorKindMask kinds = AnyActorKind) const;
+    // actors whose circle touches the circle
+    void queryCircle(glm::vec3 center, float radius, std::vector<Actor *> &result,
+                     ActorKindMask kinds = AnyActorKind) const;
+    // actors whose circle touches the rectangle [from, to]
+    void queryRect(int depth, glm::vec2 from, glm::vec2 to, std::vector<Actor *> &result,
+                   ActorKindMask kinds = AnyActorKind) const;
+
+private:
+    struct Entry
+    {
+        Actor *actor = nullptr;
+        glm::vec2 position{0};
+        float size = 0.0f;
+        ActorKindMask kind = 0; // MaskOf(actor->getKind())
+    };
+
+    static glm::ivec3 CellOf(glm::vec3 position);
+    static uint64_t CellKey(glm::ivec3 cell);
+    static Entry MakeEntry(Actor *actor);
+
+    // distanceTo(actor position on the layer) is compared with the actor size for actors of the cells
+    // overlapping [from, to] grown by the biggest actor size
+    template <typename Distance>
+    void query(int depth, glm::vec2 from, glm::vec2 to, ActorKindMask kinds, std::vector<Actor *> &result,
+               Distance &&distanceTo) const;
+
+private:
+    std::unordered_map<uint64_t, std::vector<Entry>> cells;
+    std::unordered_map<Actor *, glm::ivec3> actorCells;
+    // never shrinks, actors rarely change their size
+    float maxActorSize = 0.0f;
+};
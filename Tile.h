@@ -5,7 +5,7 @@
 //{
 //};
 
-using TileClassId = int;
+using TileClassId = uint8_t;
 
 struct TileClass
 {
@@ -25,12 +25,17 @@ struct Tile
     , actualStrength{prototype.initialStrength}
     {}
 
-    int classId = 0;
+    TileClassId classId = 0;
     int16_t actualStrength = 0;
 
+    bool operator==(const Tile &) const = default;
+
     const static Tile& Empty()
     {
         static Tile empty;
         return empty;
     }
-};
\ No newline at end of file
+};
+
+// isSolid of every class, indexed by TileClassId
+using TileSolidity = std::array<bool, std::numeric_limits<TileClassId>::max() + 1>;
\ No newline at end of file
@@ -1,53 +1,148 @@
 #include "stdafx.h"
 
 #include "Actor.h"
+#include "JobSystem.h"
 #include "World.h"
 #include "WorldGenerator.h"
 
-LevelLayer::LevelLayer(glm::ivec2 horizontalDimensions, int depth) :
-    size{horizontalDimensions}, depth{depth}
+namespace
+{
+    // FNV-1a over the values
+    size_t HashValues(std::initializer_list<int64_t> values)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const auto value : values)
+            hash = (hash ^ static_cast<uint64_t>(value)) * 0x100000001b3ull;
+        return static_cast<size_t>(hash);
+    }
+} // namespace
+
+LevelLayer::LevelLayer(glm::ivec2 horizontalDimensions, int depth, const TileSolidity &solidity) :
+    size{horizontalDimensions}, depth{depth}, solidity{solidity}
 {    
 }
 
-Tile &LevelLayer::getTileUnsafe(glm::ivec2 pos)
+void LevelLayer::swap(LevelLayer &other)
+{
+    std::swap(depth, other.depth);
+    std::swap(size, other.size);
+    std::swap(revision, other.revision);
+    std::swap(dirtyRects, other.dirtyRects);
+    std::swap(dirtyLogStart, other.dirtyLogStart);
+    std::swap(solidity, other.solidity);
+    std::swap(chunks, other.chunks);
+}
+
+LevelLayer::Chunk *LevelLayer::findChunk(glm::ivec2 chunk)
 {
-    return tiles[pos.y * size.x + pos.x];
+    const auto found = chunks.find(ChunkKey(chunk));
+    return found != chunks.end() ? &found->second : nullptr;
 }
 
-const Tile &LevelLayer::getTileUnsafe(glm::ivec2 pos) const
+const LevelLayer::Chunk *LevelLayer::findChunk(glm::ivec2 chunk) const
 {
-    return tiles[pos.y * size.x + pos.x];
+    return const_cast<LevelLayer *>(this)->findChunk(chunk);
 }
 
-void LevelLayer::swap(LevelLayer &other)
+bool LevelLayer::isChunkModified(glm::ivec2 chunk) const
 {
-    std::swap(depth, other.depth);
-    std::swap(size, other.size);
-    std::swap(revision, other.revision);
-    std::swap(tiles, other.tiles);
+    const auto *found = findChunk(chunk);
+    return found && found->modified;
+}
+
+size_t LevelLayer::getChunkLoadRevision(glm::ivec2 chunk) const
+{
+    const auto *found = findChunk(chunk);
+    return found ? found->loadRevision : 0;
 }
 
-Tile &LevelLayer::getTile(glm::ivec2 pos)
+std::optional<std::span<const LevelLayer::DirtyRect>> LevelLayer::getDirtyRectsSince(size_t sinceRevision) const
 {
-    revision++;
+    if (sinceRevision < dirtyLogStart)
+        return std::nullopt;
 
-    if (!tiles.empty() && pos.x >= 0 && pos.y >= 0 && pos.x < size.x && pos.y < size.y)
-        return getTileUnsafe(pos);
+    const auto first = std::ranges::upper_bound(dirtyRects, sinceRevision, {}, &DirtyRect::revision);
+    return std::span{first, dirtyRects.end()};
+}
 
-    throw std::logic_error{"trying to modify empty layer"};
+void LevelLayer::addDirtyRect(glm::ivec2 from, glm::ivec2 to)
+{
+    dirtyRects.push_back({++revision, from, to});
+    if (dirtyRects.size() <= MaxDirtyRects)
+        return;
+
+    // dropping the older half at once keeps trimming rare
+    const auto dropped = dirtyRects.size() / 2;
+    dirtyLogStart = dirtyRects[dropped - 1].revision;
+    dirtyRects.erase(dirtyRects.begin(), dirtyRects.begin() + dropped);
 }
 
-const Tile &LevelLayer::getTile(glm::ivec2 pos) const
+std::pmr::vector<glm::ivec2> LevelLayer::getLoadedChunks(std::pmr::memory_resource *memory) const
 {
-    if (!tiles.empty() && pos.x >= 0 && pos.y >= 0 && pos.x < size.x && pos.y < size.y)
-        return getTileUnsafe(pos);
+    std::pmr::vector<glm::ivec2> result{memory};
+    result.reserve(chunks.size());
+    for (const auto &[key, chunk] : chunks)
+        result.push_back(ChunkOfKey(key));
+
+    // row by row, so that visits and hashes don't depend on the loading order
+    std::ranges::sort(result, [](glm::ivec2 a, glm::ivec2 b) { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+    return result;
+}
 
-    return Tile::Empty();
+std::span<const TileClassId> LevelLayer::getChunkClasses(glm::ivec2 chunk) const
+{
+    if (const auto *found = findChunk(chunk))
+        return found->classIds;
+    return {};
 }
 
-void LevelLayer::visit(const std::function<void(glm::ivec2, Tile &)> &visitor)
+std::span<const uint32_t> LevelLayer::getChunkSolidRows(glm::ivec2 chunk) const
 {
-    visit(visitor, {0, 0}, size);
+    if (const auto *found = findChunk(chunk))
+        return found->solidRows;
+    return {};
+}
+
+TileRef LevelLayer::getTile(glm::ivec2 pos)
+{
+    if (pos.x >= 0 && pos.y >= 0 && pos.x < size.x && pos.y < size.y && isLoaded(pos))
+        return TileRef{*this, pos};
+
+    throw std::logic_error{"trying to modify unloaded chunk"};
+}
+
+void LevelLayer::setTile(glm::ivec2 pos, const Tile &tile)
+{
+    auto *chunk = pos.x >= 0 && pos.y >= 0 && pos.x < size.x && pos.y < size.y ? findChunk(ChunkOf(pos)) : nullptr;
+    if (!chunk)
+        throw std::logic_error{"trying to modify unloaded chunk"};
+
+    if (chunk->setTile((pos.y & (ChunkSize - 1)) * ChunkSize + (pos.x & (ChunkSize - 1)), tile, solidity))
+    {
+        chunk->modified = true;
+        addDirtyRect(pos, pos + 1);
+    }
+}
+
+Tile LevelLayer::getTile(glm::ivec2 pos) const
+{
+    return findTile(pos).value_or(Tile::Empty());
+}
+
+std::optional<Tile> LevelLayer::findTile(glm::ivec2 pos) const
+{
+    if (pos.x < 0 || pos.y < 0 || pos.x >= size.x || pos.y >= size.y)
+        return Tile::Empty();
+
+    if (const auto *chunk = findChunk(ChunkOf(pos)))
+        return chunk->getTile((pos.y & (ChunkSize - 1)) * ChunkSize + (pos.x & (ChunkSize - 1)));
+
+    return std::nullopt;
+}
+
+void LevelLayer::visit(const std::function<void(glm::ivec2, Tile &)> &visitor, const CancellationToken &cancellation)
+{
+    visit(visitor, {0, 0}, size, cancellation);
 }
 
 void LevelLayer::visit(const std::function<void(glm::ivec2, const Tile &)> &visitor) const
@@ -58,37 +153,59 @@ void LevelLayer::visit(const std::function<void(glm::ivec2, const Tile &)> &visi
 void LevelLayer::visit(const std::function<void(glm::ivec2, const Tile &)> &visitor, glm::ivec2 from,
                        glm::ivec2 to) const
 {
-    from = max({0, 0}, from);
-    to = min(size, to);
+    visitTiles(from, to, visitor);
+}
 
-    for (auto y = from.y; y < to.y; ++y)
-    for (auto x = from.x; x < to.x; ++x)
-    {
-        visitor({x, y}, getTileUnsafe({x, y}));
-    }
+void LevelLayer::visit(const std::function<void(glm::ivec2, Tile &)> &visitor, glm::ivec2 from, glm::ivec2 to,
+                       const CancellationToken &cancellation)
+{
+    visitTiles(from, to, visitor, cancellation);
 }
 
-void LevelLayer::setData(std::vector<Tile> &&data)
+void LevelLayer::setChunk(glm::ivec2 chunk, std::span<const Tile> data)
 {
-    if (data.size() != (size.x * size.y))
-        throw std::logic_error{"level layer data have invalid length"};
+    if (data.size() != ChunkArea)
+        throw std::logic_error{"level layer chunk data have invalid length"};
 
-    tiles = std::move( data );
-    revision = 0;
+    auto &target = chunks[ChunkKey(chunk)];
+    target.solidRows.fill(0);
+    for (size_t index = 0; index < ChunkArea; ++index)
+    {
+        target.classIds[index] = data[index].classId;
+        target.strengths[index] = data[index].actualStrength;
+        target.solidRows[index / ChunkSize] |= solidity[data[index].classId] ? 1u << (index % ChunkSize) : 0;
+    }
+    target.loadRevision = ++revision;
+    target.modified = false;
 }
 
-void LevelLayer::visit(const std::function<void(glm::ivec2, Tile &)> &visitor, glm::ivec2 from, glm::ivec2 to)
+void LevelLayer::unloadChunk(glm::ivec2 chunk)
 {
-    from = max({0, 0}, from);
-    to = min(size, to);
+    if (chunks.erase(ChunkKey(chunk)))
+        revision++;
+}
 
-    for (auto y = from.y; y < to.y; ++y)
-    for (auto x = from.x; x < to.x; ++x)
+uint64_t LevelLayer::getContentHash() const
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](int64_t value) {
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            hash ^= static_cast<uint64_t>(value >> (byte * 8)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    };
+
+    add(depth);
+    add(size.x);
+    add(size.y);
+    visitTiles({0, 0}, size, [&add](glm::ivec2, const Tile &tile)
     {
-        visitor({x, y}, getTileUnsafe({x, y}));
-    }
+        add(tile.classId);
+        add(tile.actualStrength);
+    });
 
-    revision++;
+    return hash;
 }
 
 World::World()
@@ -97,8 +214,10 @@ World::World()
 
 World::~World()
 {
+    // pending chunks are cancelled by their slots, so nothing waits for the generator here
     //should be automatic
-    std::ranges::for_each(actors, std::bind_front(&World::callOnDestroyForActor, this));
+    for (auto &actor : actors)
+        callOnDestroyForActor(*actor);
 }
 
 LevelLayer *World::getLayer(int depth)
@@ -107,10 +226,7 @@ LevelLayer *World::getLayer(int depth)
     if (index < 0 || index >= layers.size())
         return nullptr;
 
-    if (auto* layer = std::get_if<LevelLayer>(&layers[index]))
-        return layer;
-
-    return nullptr;
+    return &layers[index].layer;
 }
 
 const LevelLayer * World::getLayer(int depth) const
@@ -120,124 +236,562 @@ const LevelLayer * World::getLayer(int depth) const
 
 World::CellType World::categorizeTile(glm::ivec3 point) const
 {
-    const auto *wallLayer = getLayer(point.z);
-    if (!wallLayer || !wallLayer->isLoaded())
-        return CellType::Unloaded;
+    CellType result;
+    categorizeTiles({&point, 1}, {&result, 1});
+    return result;
+}
 
-    const auto horizontalPoint = glm::ivec2{point.x, point.y};
-    const auto& wallClass = generator->getClasses()[wallLayer->getTile(horizontalPoint).classId];
-    if (wallClass.isSolid)
-        return World::CellType::Wall;
+void World::categorizeTiles(std::span<const glm::ivec3> points, std::span<CellType> result) const
+{
+    assert(points.size() == result.size());
 
-    const auto *floorLayer = getLayer(point.z + 1);
-    if (!floorLayer || !floorLayer->isLoaded())
-        return CellType::Unloaded;
+    constexpr auto ChunkSize = LevelLayer::ChunkSize;
+    static_assert(static_cast<int>(CellType::Floor) == static_cast<int>(CellType::Empty) + 1 &&
+                  static_cast<int>(CellType::Wall) == static_cast<int>(CellType::Empty) + 2);
 
-    const auto &floorClass = generator->getClasses()[floorLayer->getTile(horizontalPoint).classId];
-    if (floorClass.isSolid)
-        return CellType::Floor;
+    // solid planes of the wall layer and the floor layer beneath it
+    auto cachedChunk = glm::ivec3{std::numeric_limits<int>::min()};
+    std::span<const uint32_t> wallRows, floorRows;
 
-    return CellType::Empty;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const auto point = points[i];
+        const auto horizontalPoint = glm::ivec2{point.x, point.y};
+
+        const auto *wallLayer = getLayer(point.z);
+        if (!wallLayer)
+        {
+            result[i] = CellType::Unloaded;
+            continue;
+        }
+
+        // outside of the layer everything is empty
+        const auto size = wallLayer->getSize();
+        if (point.x < 0 || point.y < 0 || point.x >= size.x || point.y >= size.y)
+        {
+            result[i] = getLayer(point.z + 1) ? CellType::Empty : CellType::Unloaded;
+            continue;
+        }
+
+        const auto chunk = glm::ivec3{LevelLayer::ChunkOf(horizontalPoint), point.z};
+        if (!(chunk == cachedChunk))
+        {
+            const auto *floorLayer = getLayer(point.z + 1);
+            wallRows = wallLayer->getChunkSolidRows(xy(chunk));
+            floorRows = floorLayer ? floorLayer->getChunkSolidRows(xy(chunk)) : std::span<const uint32_t>{};
+            cachedChunk = chunk;
+        }
+
+        // the points going on along the row of the chunk are classified by the same words
+        const auto column = point.x & (ChunkSize - 1);
+        size_t run = 1;
+        while (i + run < points.size() && column + run < ChunkSize && point.x + static_cast<int>(run) < size.x &&
+               points[i + run] == point + glm::ivec3{static_cast<int>(run), 0, 0})
+            ++run;
+
+        const auto row = point.y & (ChunkSize - 1);
+        const auto runMask = run < ChunkSize ? (1u << run) - 1 : ~0u;
+        const auto walls = wallRows.empty() ? 0u : (wallRows[row] >> column) & runMask;
+        const auto floors = floorRows.empty() ? 0u : (floorRows[row] >> column) & ~walls & runMask;
+        // nothing is known without the walls, and only the walls without the floor
+        const auto known = wallRows.empty() ? 0u : floorRows.empty() ? walls : runMask;
+
+        for (size_t bit = 0; bit < run; ++bit)
+        {
+            const auto cell = static_cast<uint32_t>(CellType::Empty) + ((floors >> bit) & 1) + 2 * ((walls >> bit) & 1);
+            result[i + bit] = ((known >> bit) & 1) ? static_cast<CellType>(cell) : CellType::Unloaded;
+        }
+        i += run - 1;
+    }
 }
 
 Actor &World::addActor(std::shared_ptr<Actor> actor)
 {
-    actor->setWorld(this);
-    actors.push_back(std::move(actor));
-    const auto& actorRef = actors.back();
+    auto &actorRef = *actor;
+    actorRef.setWorld(this);
+    actorRef.setPreviousPosition(actorRef.getPosition());
+    actorRef.setHandle(actors.insert(std::move(actor)));
 
-    // if immediately initialization is not possible, will be initialized with layer
-    if (const auto *layer = getLayer(actorRef->getPosition().z))
-        callOnReadyForActor(actorRef, *layer);
+    // if immediately initialization is not possible, will be initialized with the chunks around
+    if (!tryMakeReady(actorRef))
+        waitingActors.push_back(actorRef.getHandle());
 
-    return *actorRef;
+    return actorRef;
 }
 
 void World::Update(float dt)
 {
     frameStamp++;
 
-    //   
-    for (auto& layer : layers)
+    using Clock = std::chrono::steady_clock;
+    auto phaseStart = Clock::now();
+    auto endPhase = [&phaseStart](std::chrono::nanoseconds &phase)
+    {
+        const auto now = Clock::now();
+        phase = now - phaseStart;
+        phaseStart = now;
+    };
+
+    //   
+    while (auto generated = generatedChunks->pop())
+    {
+        // chunk could be trimmed or evicted while it was generated, failed ones are asked for again by streaming
+        const int index = generated->depth - firstLayerDepth;
+        if (index < 0 || index >= layers.size() ||
+            !layers[index].pendingChunks.erase(LevelLayer::ChunkKey(generated->position)) || generated->failed)
+            continue;
+
+        auto &layer = layers[index].layer;
+        layer.setChunk(generated->position, generated->tiles);
+        onChunkLoaded(layer, generated->position);
+    }
+
+    streamChunks();
+    endPhase(lastUpdateTimings.chunks);
+
+    updateFlowFields();
+    endPhase(lastUpdateTimings.flowFields);
+    updateActors(dt);
+    endPhase(lastUpdateTimings.actors);
+    applyActorCommands();
+    endPhase(lastUpdateTimings.commands);
+    applyTileEdits();
+    endPhase(lastUpdateTimings.edits);
+    particles.update(dt, *this);
+    endPhase(lastUpdateTimings.particles);
+
+    // erasing moves the last actor into the hole, going backwards checks every one once
+    for (size_t i = actors.size(); i-- > 0;)
     {
-        std::visit(overloaded{[this, &layer](std::future<LevelLayer> &future) {
-                                  if (future.wait_until(std::chrono::system_clock::time_point::min()) !=
-                                      std::future_status::ready)
-                                      return;
+        if (actors[i]->isAlive())
+            continue;
+
+        const auto handle = actors.getHandle(i);
+        const auto dying = actors[i];
+        callOnDestroyForActor(*dying); // crutch
+        actors.erase(handle);
+    }
+    endPhase(lastUpdateTimings.removal);
+}
+
+const FlowField *World::findFlowField(SlotHandle actor) const
+{
+    const auto found = std::ranges::find(trackedActors, actor, &TrackedActor::actor);
+    return found != trackedActors.end() ? &found->field : nullptr;
+}
 
-                                  layer = future.get();
-                                  onLayerLoaded(std::get<LevelLayer>(layer));
-                                  
-                              },
-                              [](const auto&) {}},
-                   layer);
+void World::updateFlowFields()
+{
+    std::erase_if(trackedActors, [this](const TrackedActor &tracked) { return !findActor(tracked.actor); });
+    for (auto &[actor, field] : trackedActors)
+        field.update(*this, findActor(actor)->getPosition());
+}
+
+void World::updateActors(float dt)
+{
+    // Actors to update are picked before the jobs start, so that their previous positions change while no one
+    // reads them. While actors are updated, the others see them in the crowd
+    crowd.clear();
+    dueActors.assign(actors.size(), false);
+    for (size_t i = 0; i < actors.size(); ++i)
+    {
+        auto &actor = *actors[i];
+        if (actor.isReady() && getLayer(actor.getPosition().z))
+        {
+            const auto period = getUpdatePeriod(actor);
+            if (!actor.isPromoted() && (frameStamp + actor.getHandle().index) % period != 0)
+                actor.setSkippedTime(actor.getSkippedTime() + dt);
+            else
+            {
+                actor.setPreviousPosition(actor.getPosition());
+                dueActors[i] = true;
+            }
+        }
+        crowd.add(actor.getPosition(), actor.getSize(), actor.getKind(), actor.getHandle());
     }
+    crowd.build();
+
+    const auto count = actors.size();
+    const auto batchesCount = (count + ActorsPerBatch - 1) / ActorsPerBatch;
+    if (commandBatches.size() < batchesCount)
+        commandBatches.resize(batchesCount);
 
-    for (int i = layers.size(); i < maxLoadedLayers; ++i)
+    auto updateBatch = [&](size_t batch)
     {
-        layers.push_back(generator->generateLevelLayerAsync(firstLayerDepth + i));
+        const auto end = std::min(count, (batch + 1) * ActorsPerBatch);
+        for (auto i = batch * ActorsPerBatch; i < end; ++i)
+        {
+            if (!dueActors[i])
+                continue;
+
+            auto &actor = *actors[i];
+            const auto elapsed = actor.getSkippedTime() + dt;
+            actor.setSkippedTime(0.0f);
+            actor.setUpdateInterval(elapsed);
+            actor.setPromoted(false);
+            commandBatches[batch].beginActor();
+            actor.update(elapsed, *this, commandBatches[batch]);
+        }
+    };
+
+    if (jobSystem && batchesCount > 1)
+        jobSystem->parallelFor(batchesCount, updateBatch, ActorsUpdatePriority);
+    else
+    {
+        for (size_t batch = 0; batch < batchesCount; ++batch)
+            updateBatch(batch);
     }
+}
 
+void World::applyActorCommands()
+{
+    // edits dropped on the way count into the stats of this update
+    lastEditStats = {};
     for (auto &actor : actors)
+        collisionGrid.update(actor.get());
+
+    // batches and their commands are in the order of the actors, however the batches were spread over the threads.
+    // Added actors go to the end of the dense array and wait for the next tick
+    for (auto &commands : commandBatches)
     {
-        if (const auto layer = getLayer(actor->getPosition().z))
-            actor->update(dt, *this);
+        applyCommands(commands);
+        commands.clear();
     }
+}
+
+size_t World::getUpdatePeriod(const Actor &actor) const
+{
+    if (!simulationFocus || simulationFocus->views.empty())
+        return UpdatePeriods[0];
+
+    // layers above and below the visible ones are measured against the view of the nearest visible one
+    const auto &views = simulationFocus->views;
+    const auto layer = static_cast<int>(actor.getPosition().z) - simulationFocus->firstDepth;
+    const auto layersCount = static_cast<int>(views.size());
+    const auto &view = views[std::clamp(layer, 0, layersCount - 1)];
+
+    // in tiles between the actor and the view, actors on its edge are partly visible
+    const auto position = xy(actor.getPosition());
+    const auto gap = max(max(glm::vec2{view.from} - position, position - glm::vec2{view.to}), 0.0f);
+    const auto distance = std::max(gap.x, gap.y);
+    if (distance <= actor.getSize() && layer >= 0 && layer < layersCount)
+        return UpdatePeriods[0];
+    if (distance <= FarDistance && layer >= -DepthMargin && layer < layersCount + DepthMargin)
+        return UpdatePeriods[1];
+    return UpdatePeriods[2];
+}
+
+void World::promoteActor(Actor &actor)
+{
+    actor.setPromoted(true);
+}
 
-    auto tailRange = std::ranges::remove_if(actors, [this](std::shared_ptr<Actor> &actor)
+void World::applyCommands(const WorldCommands &commands)
+{
+    for (const auto &command : commands.getCommands())
     {
-        bool isDying = !actor->isAlive();
-        if (isDying) // crutch
-            callOnDestroyForActor(actor);
-        return isDying;
-    });
+        std::visit(overloaded{
+            [this](const WorldCommands::SetTile &edit) { queueTileEdit(edit); },
+            [this](const WorldCommands::FillRound &fill) { queueTileEdit(fill); },
+            [this](const WorldCommands::MoveTileDown &move) { queueTileEdit(move); },
+            [this](const WorldCommands::BeginActor &) { ++editGroup; },
+            [this](const WorldCommands::AddActor &spawn) { addActor(spawn.actor); },
+            [this](const WorldCommands::SpawnProjectile &shot)
+            {
+                particles.spawnProjectile(shot.particle, shot.flash, shot.explosion);
+            },
+            [this](const WorldCommands::Explode &blast) { particles.explode(blast.flash, blast.explosion); },
+            [this](const WorldCommands::TrackActor &track)
+            {
+                if (findActor(track.actor) && !findFlowField(track.actor))
+                    trackedActors.push_back({track.actor});
+            },
+        }, command);
+    }
+}
 
-    actors.erase(tailRange.begin(), tailRange.end());
+void World::queueTileEdit(const TileEdit &edit)
+{
+    // a whole group is dropped, so that it isn't left half done
+    const bool startsGroup = pendingEdits.empty() || pendingEdits.back().group != editGroup;
+    if (startsGroup && pendingEdits.size() >= MaxPendingEdits)
+        droppedGroup = editGroup;
+
+    // Actors don't see their edits before they are applied and ask for them again meanwhile.
+    // Edits in between are ignored: the covered one would be made by the queued one a bit earlier
+    const auto *fill = std::get_if<WorldCommands::FillRound>(&edit);
+    const auto radii = fill ? queuedFillRadii.find({fill->center, fill->tile}) : queuedFillRadii.end();
+    const bool covered = radii != queuedFillRadii.end() && std::ranges::max(radii->second) >= fill->radius;
+    if (droppedGroup == editGroup || covered || queuedEdits.contains(edit))
+    {
+        ++lastEditStats.droppedEdits;
+        return;
+    }
 
+    pendingEdits.push_back({edit, editGroup});
+    queuedEdits.insert(edit);
+    if (fill)
+        queuedFillRadii[{fill->center, fill->tile}].push_back(fill->radius);
+}
+
+void World::unqueueTileEdit(const TileEdit &edit)
+{
+    queuedEdits.erase(edit);
+    if (const auto *fill = std::get_if<WorldCommands::FillRound>(&edit))
+    {
+        const auto radii = queuedFillRadii.find({fill->center, fill->tile});
+        radii->second.erase(std::ranges::find(radii->second, fill->radius));
+        if (radii->second.empty())
+            queuedFillRadii.erase(radii);
+    }
+}
+
+size_t World::TileEditHash::operator()(const TileEdit &edit) const
+{
+    return std::visit(overloaded{
+        [](const WorldCommands::SetTile &set)
+        {
+            const auto position = set.position;
+            return HashValues({0, position.x, position.y, position.z, set.tile.classId, set.tile.actualStrength});
+        },
+        [](const WorldCommands::FillRound &fill)
+        {
+            const auto center = fill.center;
+            return HashValues({1, center.x, center.y, center.z, fill.radius, fill.tile.classId,
+                               fill.tile.actualStrength});
+        },
+        [](const WorldCommands::MoveTileDown &move)
+        {
+            return HashValues({2, move.position.x, move.position.y, move.position.z});
+        },
+    }, edit);
+}
+
+size_t World::QueuedFillHash::operator()(const QueuedFill &fill) const
+{
+    const auto center = fill.center;
+    return HashValues({center.x, center.y, center.z, fill.tile.classId, fill.tile.actualStrength});
+}
+
+void World::applyTileEdits()
+{
+    // the square around a round area is close enough
+    auto tilesOf = overloaded{
+        [](const WorldCommands::SetTile &) { return size_t{1}; },
+        [](const WorldCommands::FillRound &fill)
+        {
+            const auto side = static_cast<size_t>(2 * fill.radius + 1);
+            return side * side;
+        },
+        [](const WorldCommands::MoveTileDown &) { return size_t{2}; },
+    };
+
+    lastEditStats.appliedEdits = lastEditStats.appliedTiles = 0;
+    while (!pendingEdits.empty())
+    {
+        const auto group = pendingEdits.front().group;
+        const auto groupEnd = std::ranges::find_if(pendingEdits, [group](const QueuedEdit &queued)
+        {
+            return queued.group != group;
+        });
+
+        size_t tiles = 0;
+        for (auto it = pendingEdits.begin(); it != groupEnd; ++it)
+            tiles += std::visit(tilesOf, it->edit);
+        if (lastEditStats.appliedEdits > 0 && lastEditStats.appliedTiles + tiles > EditedTilesPerTick)
+            break;
+
+        for (auto it = pendingEdits.begin(); it != groupEnd; ++it)
+        {
+            std::visit(overloaded{
+                [this](const WorldCommands::SetTile &edit)
+                {
+                    auto *layer = getLayer(edit.position.z);
+                    if (layer && layer->isLoaded(xy(edit.position)))
+                        layer->setTile(xy(edit.position), edit.tile);
+                },
+                [this](const WorldCommands::FillRound &fill)
+                {
+                    if (auto *layer = getLayer(fill.center.z))
+                        FillRoundArea(*layer, xy(fill.center), fill.radius, fill.tile);
+                },
+                [this](const WorldCommands::MoveTileDown &move)
+                {
+                    // the tile could have been blown up or moved since it was asked for
+                    auto *layer = getLayer(move.position.z), *layerBeneath = getLayer(move.position.z + 1);
+                    const auto position = xy(move.position);
+                    const auto tile = layer ? layer->findTile(position) : std::nullopt;
+                    if (!tile || *tile == Tile::Empty() || !layerBeneath || !layerBeneath->isLoaded(position))
+                        return;
+
+                    layerBeneath->setTile(position, *tile);
+                    layer->setTile(position, Tile::Empty());
+                },
+            }, it->edit);
+            unqueueTileEdit(it->edit);
+            ++lastEditStats.appliedEdits;
+        }
+        pendingEdits.erase(pendingEdits.begin(), groupEnd);
+        lastEditStats.appliedTiles += tiles;
+    }
+    lastEditStats.deferredEdits = pendingEdits.size();
 }
 
 void World::trimLevelsAbove(int minimalInterestingDepth)
 {
     ////   . , 
-    while ((!layers.empty() && std::holds_alternative<LevelLayer>(layers.front()) &&
-            std::get<LevelLayer>(layers.front()).getDepth() < minimalInterestingDepth))
+    // pending chunks are dropped as well, their generation is cancelled by the slot
+    while (!layers.empty() && firstLayerDepth < minimalInterestingDepth)
     {
-        layers.erase(layers.begin());
+        layers.pop_front();
         firstLayerDepth++;
     }
 
 }
 
-const std::vector<Actor *> &World::queryPoint(glm::vec3 point)
+void World::streamChunks()
 {
-    static std::vector<Actor *> container;
-    container.clear();
+    const auto dimensions = glm::ivec2{generator->getLayerDimensions()};
+    const auto &solidity = generator->getSolidity();
+    while (layers.size() < maxLoadedLayers)
+        layers.push_back({LevelLayer{dimensions, firstLayerDepth + static_cast<int>(layers.size()), solidity}});
 
-    for (auto* actor : collideableActors)
+    // in tiles, between the chunk and the nearest streaming area
+    auto distanceToAreas = [this](glm::ivec2 chunk)
     {
-        if (floor(actor->getPosition().z) == floor(point.z) &&
-            glm::length(xy(actor->getPosition()) - xy(point)) <= static_cast<float>(actor->getSize()))
-            container.push_back(actor);
+        const auto from = chunk * LevelLayer::ChunkSize, to = from + LevelLayer::ChunkSize;
+        int distance = std::numeric_limits<int>::max();
+        for (const auto &area : streamingAreas)
+        {
+            const auto gap = max(max(area.from - to, from - area.to), 0);
+            distance = std::min(distance, std::max(gap.x, gap.y));
+        }
+        return distance;
+    };
+
+    // Actors away from the areas keep the ground around them and beneath them loaded, so that they get ready
+    // and move wherever they are
+    actorChunks.clear();
+    for (const auto &actor : actors)
+    {
+        const auto actorDepth = static_cast<int>(actor->getPosition().z);
+        const auto [firstChunk, lastChunk] = ReadyChunksOf(actor->getPosition(), dimensions);
+        for (int depth = actorDepth; depth <= actorDepth + 1; ++depth)
+        for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+        for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+            actorChunks.push_back({depth, LevelLayer::ChunkKey({cx, cy})});
     }
+    std::ranges::sort(actorChunks);
+    actorChunks.erase(std::ranges::unique(actorChunks).begin(), actorChunks.end());
 
-    return container;
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        auto &[layer, pendingChunks] = layers[i];
+
+        const auto layerActorChunks = std::ranges::equal_range(actorChunks, layer.getDepth(), {},
+                                                               &std::pair<int, uint64_t>::first);
+        auto isActorChunk = [&](glm::ivec2 chunk)
+        {
+            return std::ranges::binary_search(layerActorChunks, LevelLayer::ChunkKey(chunk), {},
+                                              &std::pair<int, uint64_t>::second);
+        };
+
+        layer.unloadChunksIf([&](glm::ivec2 chunk)
+        {
+            return !layer.isChunkModified(chunk) && distanceToAreas(chunk) > evictionDistance && !isActorChunk(chunk);
+        });
+
+        std::erase_if(pendingChunks, [&](const auto &pending)
+        {
+            const auto chunk = pending.second.position;
+            return distanceToAreas(chunk) > evictionDistance && !isActorChunk(chunk);
+        });
+
+        auto request = [&](glm::ivec2 chunk, int priority)
+        {
+            const auto key = LevelLayer::ChunkKey(chunk);
+            if (layer.isChunkLoaded(chunk) || pendingChunks.contains(key))
+                return;
+
+            PendingChunk pending{chunk};
+            generator->generateChunkAsync(layer.getDepth(), chunk, priority, pending.cancellation.getToken(),
+                                          [queue = generatedChunks](GeneratedChunk &&generated)
+                                          { queue->push(std::move(generated)); });
+            pendingChunks.emplace(key, std::move(pending));
+        };
+
+        for (const auto &area : streamingAreas)
+        {
+            const auto from = max(area.from, 0), to = min(area.to, layer.getSize());
+            if (from.x >= to.x || from.y >= to.y)
+                continue;
+
+            const auto firstChunk = LevelLayer::ChunkOf(from), lastChunk = LevelLayer::ChunkOf(to - 1);
+            const auto centerChunk = (firstChunk + lastChunk) / 2;
+            for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+            for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+            {
+                // layers nearest to the top (i.e. to the player) are the most urgent ones, then the middle of the area
+                const auto offset = abs(glm::ivec2{cx, cy} - centerChunk);
+                request({cx, cy}, static_cast<int>(i) * 256 + std::min(std::max(offset.x, offset.y), 255));
+            }
+        }
+
+        // after the areas of the layer
+        for (const auto &[depth, key] : layerActorChunks)
+            request(LevelLayer::ChunkOfKey(key), static_cast<int>(i) * 256 + 255);
+    }
 }
 
-void World::onLayerLoaded(const LevelLayer &layer)
+void World::onChunkLoaded(const LevelLayer &layer, glm::ivec2 chunk)
 {
-    for (const auto &actor : actors)
-        callOnReadyForActor(actor, layer);
+    std::erase_if(waitingActors, [&](SlotHandle handle)
+    {
+        auto *actor = findActor(handle);
+        if (!actor)
+            return true;
+        if (static_cast<int>(actor->getPosition().z) != layer.getDepth())
+            return false;
+
+        const auto [firstChunk, lastChunk] = ReadyChunksOf(actor->getPosition(), layer.getSize());
+        const bool touches = chunk.x >= firstChunk.x && chunk.y >= firstChunk.y &&
+                             chunk.x <= lastChunk.x && chunk.y <= lastChunk.y;
+        return touches && tryMakeReady(*actor);
+    });
 }
 
-void World::callOnReadyForActor(const std::shared_ptr<Actor> &actor, const LevelLayer &layer)
+std::pair<glm::ivec2, glm::ivec2> World::ReadyChunksOf(glm::vec3 position, glm::ivec2 layerSize)
 {
-    if (static_cast<int>(actor->getPosition().z) == layer.getDepth())
-        actor->onReady(*this);
+    const auto center = glm::ivec2{xy(position)};
+    const auto from = max(center - ActorReadyRadius, 0), to = min(center + ActorReadyRadius, layerSize - 1);
+    return {LevelLayer::ChunkOf(from), LevelLayer::ChunkOf(to)};
+}
+
+bool World::tryMakeReady(Actor &actor)
+{
+    if (actor.isReady())
+        return true;
+
+    const auto *layer = getLayer(actor.getPosition().z);
+    if (!layer)
+        return false;
+
+    const auto [firstChunk, lastChunk] = ReadyChunksOf(actor.getPosition(), layer->getSize());
+    for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+    for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+    {
+        if (!layer->isChunkLoaded({cx, cy}))
+            return false;
+    }
+
+    actor.setReady(true);
+    actor.onReady(*this);
+    return true;
 }
 
-void World::callOnDestroyForActor(const std::shared_ptr<Actor> &actor)
+void World::callOnDestroyForActor(Actor &actor)
 {
-    unregisterForCollision(actor.get());
-    actor->onDestroy(*this);
-    actor->setWorld(nullptr);
+    unregisterForCollision(&actor);
+    actor.onDestroy(*this);
+    actor.setWorld(nullptr);
 }
\ No newline at end of file
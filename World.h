@@ -1,36 +1,181 @@
 #pragma once
 
+#include "Cancellation.h"
+#include "CrowdGrid.h"
+#include "FlowField.h"
+#include "MpscQueue.h"
+#include "ParticleSystem.h"
+#include "SlotMap.h"
+#include "SpatialGrid.h"
 #include "Tile.h"
+#include "WorldCommands.h"
 
 class Actor;
+class JobSystem;
 class WorldGenerator;
+class TileRef;
 
 class LevelLayer
 {
 public:
+    static constexpr int ChunkSize = 32;
+
     LevelLayer() { std::puts("hello"); } // -    future,   
-    explicit LevelLayer(glm::ivec2 horizontalDimensions, int heightOffset);
+    // solidity of the tile classes feeds the solid planes of the chunks
+    explicit LevelLayer(glm::ivec2 horizontalDimensions, int heightOffset, const TileSolidity &solidity = {});
 
     int getDepth() const { return depth; }
     glm::ivec2 getSize() const { return size; }
+    glm::ivec2 getChunksCount() const { return (size + ChunkSize - 1) / ChunkSize; }
+    // changes with every write that changes a tile and with every chunk loaded or unloaded
     size_t getRevision() const { return revision; }
-    const bool isLoaded() const { return !tiles.empty(); }
 
-        //    std::span<const Tile> getData() const { return tiles; }
+    // tiles [from, to) written at the revision
+    struct DirtyRect
+    {
+        size_t revision = 0;
+        glm::ivec2 from{0}, to{0};
+    };
 
-    Tile &getTile(glm::ivec2 pos);
-    const Tile &getTile(glm::ivec2 pos) const;
+    // Rectangles written after the revision, oldest first. Nothing when the log doesn't reach that far back,
+    // every tile has to be considered changed then. Chunk loads aren't logged, see getChunkLoadRevision
+    std::optional<std::span<const DirtyRect>> getDirtyRectsSince(size_t sinceRevision) const;
+
+    // Tiles live in chunks of ChunkSize x ChunkSize that are loaded and unloaded independently
+    static glm::ivec2 ChunkOf(glm::ivec2 pos) { return {pos.x >> ChunkShift, pos.y >> ChunkShift}; }
+    static uint64_t ChunkKey(glm::ivec2 chunk)
+    {
+        return (uint64_t{static_cast<uint32_t>(chunk.y)} << 32) | static_cast<uint32_t>(chunk.x);
+    }
+    static glm::ivec2 ChunkOfKey(uint64_t key)
+    {
+        return {static_cast<int32_t>(key & 0xffffffff), static_cast<int32_t>(key >> 32)};
+    }
+    bool isLoaded(glm::ivec2 pos) const { return isChunkLoaded(ChunkOf(pos)); }
+    bool isChunkLoaded(glm::ivec2 chunk) const { return chunks.contains(ChunkKey(chunk)); }
+    bool isChunkModified(glm::ivec2 chunk) const;
+    // changes when the chunk is loaded again, 0 for unloaded chunks
+    size_t getChunkLoadRevision(glm::ivec2 chunk) const;
+    // row by row, in memory of the resource
+    std::pmr::vector<glm::ivec2> getLoadedChunks(
+        std::pmr::memory_resource *memory = std::pmr::get_default_resource()) const;
+    // ChunkSize * ChunkSize classes of the chunk row by row, empty for unloaded chunks
+    std::span<const TileClassId> getChunkClasses(glm::ivec2 chunk) const;
+    // bit x of word y is set when tile {x, y} of the chunk is solid, empty for unloaded chunks
+    std::span<const uint32_t> getChunkSolidRows(glm::ivec2 chunk) const;
 
-    void visit(const std::function<void(glm::ivec2, Tile &)> &visitor);
+        //    std::span<const Tile> getData() const { return tiles; }
+
+    // throws for tiles of unloaded chunks. Reading through it doesn't count as a change
+    TileRef getTile(glm::ivec2 pos);
+    // throws for tiles of unloaded chunks, writing the same tile again isn't a change
+    void setTile(glm::ivec2 pos, const Tile &tile);
+    // empty tile outside of the layer and of the loaded chunks
+    Tile getTile(glm::ivec2 pos) const;
+    // nothing for tiles of unloaded chunks, the empty tile outside of the layer
+    std::optional<Tile> findTile(glm::ivec2 pos) const;
+
+    // Visits cover loaded chunks only. Mutable visitors get a copy of the tile that is written back afterwards,
+    // the bounds of the tiles that really changed become one dirty rectangle.
+    // Mutable visits stop at the next row once cancellation is requested
+    void visit(const std::function<void(glm::ivec2, Tile &)> &visitor, const CancellationToken &cancellation = {});
     void visit(const std::function<void(glm::ivec2, const Tile &)> &visitor) const;
-    void visit(const std::function<void(glm::ivec2, Tile &)> &visitor, glm::ivec2 from, glm::ivec2 to);
+    void visit(const std::function<void(glm::ivec2, Tile &)> &visitor, glm::ivec2 from, glm::ivec2 to,
+               const CancellationToken &cancellation = {});
     void visit(const std::function<void(glm::ivec2, const Tile &)> &visitor, glm::ivec2 from, glm::ivec2 to) const;
 
-    void setData(std::vector<Tile> &&data);
+    // The same visits for visitors the compiler can see through: visitor(pos, tile) is inlined into the loop
+    template <typename Visitor>
+    void visitTiles(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor, const CancellationToken &cancellation = {});
+    template <typename Visitor>
+    void visitTiles(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor) const;
+
+    // visitor(rowStart, classes, strengths) gets the planes of a row of a chunk inside [from, to), at most
+    // ChunkSize tiles long. Tiles the visitor changed in place become one dirty rectangle
+    template <typename Visitor>
+    void visitRows(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor, const CancellationToken &cancellation = {});
+    template <typename Visitor>
+    void visitRows(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor) const;
+
+    // ChunkSize * ChunkSize tiles row by row, tiles beyond the layer size are ignored
+    void setChunk(glm::ivec2 chunk, std::span<const Tile> data);
+    void unloadChunk(glm::ivec2 chunk);
+    // unloads the chunks predicate(chunk) is true for, going through them in no particular order
+    template <typename Predicate>
+    void unloadChunksIf(Predicate &&predicate);
+
+    // FNV-1a of the size, depth and every loaded tile, for regression checks of the generator
+    uint64_t getContentHash() const;
 
 private:
-    Tile &getTileUnsafe(glm::ivec2 pos);
-    const Tile &getTileUnsafe(glm::ivec2 pos)const;
+    static constexpr int ChunkShift = 5;
+    static_assert(ChunkSize == 1 << ChunkShift);
+    static_assert(ChunkSize == 32, "a row of the solid plane is one uint32_t");
+
+    static constexpr size_t ChunkArea = ChunkSize * ChunkSize;
+
+    struct Chunk
+    {
+        // tiles row by row as planes: classes are scanned far more often than strengths
+        std::array<TileClassId, ChunkArea> classIds{};
+        std::array<int16_t, ChunkArea> strengths{};
+        std::array<uint32_t, ChunkSize> solidRows{};
+        size_t loadRevision = 0;
+        bool modified = false; // modified chunks are never unloaded, they can't be generated again
+
+        Tile getTile(size_t index) const
+        {
+            Tile tile;
+            tile.classId = classIds[index];
+            tile.actualStrength = strengths[index];
+            return tile;
+        }
+
+        // false if the tile was the same already
+        bool setTile(size_t index, const Tile &tile, const TileSolidity &solidity)
+        {
+            if (classIds[index] == tile.classId && strengths[index] == tile.actualStrength)
+                return false;
+
+            classIds[index] = tile.classId;
+            strengths[index] = tile.actualStrength;
+
+            updateSolid(index, solidity);
+            return true;
+        }
+
+        void updateSolid(size_t index, const TileSolidity &solidity)
+        {
+            const auto bit = 1u << (index % ChunkSize);
+            auto &row = solidRows[index / ChunkSize];
+            row = solidity[classIds[index]] ? row | bit : row & ~bit;
+        }
+    };
+
+    // bounds of the tiles a mutable visit really changed
+    struct ChangedBounds
+    {
+        glm::ivec2 from{std::numeric_limits<int>::max()};
+        glm::ivec2 to{std::numeric_limits<int>::min()};
+
+        void add(glm::ivec2 pos)
+        {
+            from = min(from, pos);
+            to = max(to, pos + 1);
+        }
+        bool isEmpty() const { return from.x >= to.x; }
+    };
+
+    static constexpr size_t MaxDirtyRects = 1024;
+
+    void addDirtyRect(glm::ivec2 from, glm::ivec2 to);
+
+    Chunk *findChunk(glm::ivec2 chunk);
+    const Chunk *findChunk(glm::ivec2 chunk) const;
+    // visitor(origin, chunk, from, to) gets the loaded chunks overlapping [from, to) of the layer with the overlap
+    // in chunk coordinates, row of chunks by row. Returning false stops the visit
+    template <typename Visitor>
+    void visitChunks(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor);
 
     void swap(LevelLayer &other);
 
@@ -39,8 +184,197 @@ private:
     glm::ivec2 size;
 
     size_t revision = 0;
+    // oldest first, trimmed to MaxDirtyRects. Consumers older than dirtyLogStart get nothing
+    std::vector<DirtyRect> dirtyRects;
+    size_t dirtyLogStart = 0;
+
+    TileSolidity solidity{};
+    std::unordered_map<uint64_t, Chunk> chunks;
+};
+
+template <typename Visitor>
+void LevelLayer::visitChunks(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor)
+{
+    from = max({0, 0}, from);
+    to = min(size, to);
+    if (from.x >= to.x || from.y >= to.y)
+        return;
+
+    const auto firstChunk = ChunkOf(from);
+    const auto lastChunk = ChunkOf(to - 1);
+    auto visitChunk = [&](glm::ivec2 position, Chunk &chunk)
+    {
+        const auto origin = position * ChunkSize;
+        return visitor(origin, chunk, max(from - origin, 0), min(to - origin, ChunkSize));
+    };
 
+    // big areas of huge layers are mostly unloaded, going through the loaded chunks is cheaper then
+    const auto area = lastChunk - firstChunk + 1;
+    if (static_cast<int64_t>(area.x) * area.y > static_cast<int64_t>(chunks.size()))
+    {
+        for (auto position : getLoadedChunks())
+        {
+            if (all(greaterThanEqual(position, firstChunk)) && all(lessThanEqual(position, lastChunk)) &&
+                !visitChunk(position, *findChunk(position)))
+                return;
+        }
+        return;
+    }
+
+    for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+    for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+    {
+        auto *chunk = findChunk({cx, cy});
+        if (chunk && !visitChunk({cx, cy}, *chunk))
+            return;
+    }
+}
+
+template <typename Visitor>
+void LevelLayer::visitTiles(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor, const CancellationToken &cancellation)
+{
+    ChangedBounds changed;
+    visitChunks(from, to, [&](glm::ivec2 origin, Chunk &chunk, glm::ivec2 chunkFrom, glm::ivec2 chunkTo)
+    {
+        for (auto y = chunkFrom.y; y < chunkTo.y; ++y)
+        {
+            if (cancellation.isCancelled())
+                return false;
+
+            for (auto x = chunkFrom.x; x < chunkTo.x; ++x)
+            {
+                const auto pos = origin + glm::ivec2{x, y};
+                auto tile = chunk.getTile(y * ChunkSize + x);
+                visitor(pos, tile);
+                if (chunk.setTile(y * ChunkSize + x, tile, solidity))
+                {
+                    chunk.modified = true;
+                    changed.add(pos);
+                }
+            }
+        }
+        return true;
+    });
+
+    if (!changed.isEmpty())
+        addDirtyRect(changed.from, changed.to);
+}
+
+template <typename Visitor>
+void LevelLayer::visitTiles(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor) const
+{
+    const_cast<LevelLayer *>(this)->visitChunks(from, to, [&](glm::ivec2 origin, const Chunk &chunk,
+                                                              glm::ivec2 chunkFrom, glm::ivec2 chunkTo)
+    {
+        for (auto y = chunkFrom.y; y < chunkTo.y; ++y)
+        for (auto x = chunkFrom.x; x < chunkTo.x; ++x)
+        {
+            const auto tile = chunk.getTile(y * ChunkSize + x);
+            visitor(origin + glm::ivec2{x, y}, tile);
+        }
+        return true;
+    });
+}
+
+template <typename Visitor>
+void LevelLayer::visitRows(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor, const CancellationToken &cancellation)
+{
+    ChangedBounds changed;
+    visitChunks(from, to, [&](glm::ivec2 origin, Chunk &chunk, glm::ivec2 chunkFrom, glm::ivec2 chunkTo)
+    {
+        const auto width = static_cast<size_t>(chunkTo.x - chunkFrom.x);
+        for (auto y = chunkFrom.y; y < chunkTo.y; ++y)
+        {
+            if (cancellation.isCancelled())
+                return false;
+
+            // the visitor writes in place, the copy tells what it changed
+            const auto first = static_cast<size_t>(y * ChunkSize + chunkFrom.x);
+            std::array<TileClassId, ChunkSize> oldClasses;
+            std::array<int16_t, ChunkSize> oldStrengths;
+            std::copy_n(chunk.classIds.begin() + first, width, oldClasses.begin());
+            std::copy_n(chunk.strengths.begin() + first, width, oldStrengths.begin());
+
+            visitor(origin + glm::ivec2{chunkFrom.x, y}, std::span{chunk.classIds.data() + first, width},
+                    std::span{chunk.strengths.data() + first, width});
+
+            auto isSame = [&](size_t x)
+            {
+                return chunk.classIds[first + x] == oldClasses[x] && chunk.strengths[first + x] == oldStrengths[x];
+            };
+            size_t firstChanged = 0, lastChanged = width;
+            while (firstChanged < width && isSame(firstChanged))
+                ++firstChanged;
+            if (firstChanged == width)
+                continue;
+            while (isSame(lastChanged - 1))
+                --lastChanged;
+
+            for (auto x = firstChanged; x < lastChanged; ++x)
+                chunk.updateSolid(first + x, solidity);
+            chunk.modified = true;
+            changed.add(origin + glm::ivec2{chunkFrom.x + static_cast<int>(firstChanged), y});
+            changed.add(origin + glm::ivec2{chunkFrom.x + static_cast<int>(lastChanged) - 1, y});
+        }
+        return true;
+    });
+
+    if (!changed.isEmpty())
+        addDirtyRect(changed.from, changed.to);
+}
+
+template <typename Visitor>
+void LevelLayer::visitRows(glm::ivec2 from, glm::ivec2 to, Visitor &&visitor) const
+{
+    const_cast<LevelLayer *>(this)->visitChunks(from, to, [&](glm::ivec2 origin, const Chunk &chunk,
+                                                              glm::ivec2 chunkFrom, glm::ivec2 chunkTo)
+    {
+        const auto width = static_cast<size_t>(chunkTo.x - chunkFrom.x);
+        for (auto y = chunkFrom.y; y < chunkTo.y; ++y)
+        {
+            const auto first = static_cast<size_t>(y * ChunkSize + chunkFrom.x);
+            visitor(origin + glm::ivec2{chunkFrom.x, y}, std::span{chunk.classIds.data() + first, width},
+                    std::span{chunk.strengths.data() + first, width});
+        }
+        return true;
+    });
+}
+
+template <typename Predicate>
+void LevelLayer::unloadChunksIf(Predicate &&predicate)
+{
+    revision += std::erase_if(chunks, [&](const auto &entry) { return predicate(ChunkOfKey(entry.first)); });
+}
+
+// Writable tile of a LevelLayer, which keeps classes and strengths in separate planes.
+// Assigning a tile writes it through, copying it to a Tile reads it
+class TileRef
+{
+public:
+    TileRef(LevelLayer &layer, glm::ivec2 position) : layer{layer}, position{position} {}
+
+    TileRef &operator=(const Tile &tile)
+    {
+        layer.setTile(position, tile);
+        return *this;
+    }
+
+    TileRef &operator=(const TileRef &other) { return *this = static_cast<Tile>(other); }
+
+    operator Tile() const { return static_cast<const LevelLayer &>(layer).getTile(position); }
+
+private:
+    LevelLayer &layer;
+    glm::ivec2 position;
+};
+
+// generated tiles of a chunk on their way from a worker to the world
+struct GeneratedChunk
+{
+    int depth = 0;
+    glm::ivec2 position{0};
     std::vector<Tile> tiles;
+    bool failed = false; // no tiles, the chunk has to be asked for again
 };
 
 class World
@@ -55,7 +389,36 @@ public:
         Ramp
     };
 
-    using ActorsList = std::list<std::shared_ptr<Actor>>;
+    // dense, removing an actor moves the last one into its place
+    using ActorsList = SlotMap<std::shared_ptr<Actor>>;
+
+    // tiles [from, to) of every kept layer that should be loaded
+    struct StreamingArea
+    {
+        glm::ivec2 from{0}, to{0};
+    };
+
+    // What the player sees: tiles [from, to) of the window on every visible layer, the first one is of firstDepth.
+    // Actors in view are updated every tick, the further ones less often
+    struct SimulationFocus
+    {
+        int firstDepth = 0;
+        std::vector<StreamingArea> views;
+    };
+
+    // how long the phases of an update took, applying the commands of the actors includes moving them in the grid
+    struct UpdateTimings
+    {
+        std::chrono::nanoseconds chunks{0}, flowFields{0}, actors{0}, commands{0}, edits{0}, particles{0}, removal{0};
+    };
+
+    // Tile edits actors asked for, applied in the last update or left over the budget for the next ones.
+    // Dropped ones were already queued, covered by a queued fill or over MaxPendingEdits
+    struct EditStats
+    {
+        size_t appliedEdits = 0, appliedTiles = 0;
+        size_t deferredEdits = 0, droppedEdits = 0;
+    };
 
 public:
     explicit World();
@@ -64,45 +427,206 @@ public:
     LevelLayer *getLayer(int depth);
     const LevelLayer *getLayer(int depth) const ;
     CellType categorizeTile(glm::ivec3 point) const;
+    // The same for every point, consecutive points in one chunk share its lookups.
+    // Points going on along a row of a chunk, x by x, are classified with a few operations on its words
+    void categorizeTiles(std::span<const glm::ivec3> points, std::span<CellType> result) const;
 
 
     Actor &addActor(std::shared_ptr<Actor> actor);
     const ActorsList &getActors() const { return actors; }
+    // nothing once the actor has been removed from the world
+    Actor *findActor(SlotHandle handle) const
+    {
+        const auto *found = actors.find(handle);
+        return found ? found->get() : nullptr;
+    }
+
+    // every actor as it was when the tick started, for steering during the update
+    const CrowdGrid &getCrowd() const { return crowd; }
+
+    // Way to a tracked actor over the floor of its layer, shared by everyone chasing it. Nothing until the actor is
+    // tracked through WorldCommands::trackActor, fields of removed actors are dropped
+    const FlowField *findFlowField(SlotHandle actor) const;
+
+    // updated after the actors
+    ParticleSystem &getParticles() { return particles; }
+    const ParticleSystem &getParticles() const { return particles; }
     
     void Update(float dt);
+    const UpdateTimings &getLastUpdateTimings() const { return lastUpdateTimings; }
+    const EditStats &getLastEditStats() const { return lastEditStats; }
 
     std::shared_ptr<WorldGenerator> getGenerator() const { return generator; }
     void setGenerator(std::shared_ptr<WorldGenerator> _generator) { generator = std::move(_generator); }
 
+    // Actors are updated on the jobs when there are any, on the calling thread otherwise.
+    // Both give the same world
+    void setJobSystem(std::shared_ptr<JobSystem> _jobSystem) { jobSystem = std::move(_jobSystem); }
+
     void trimLevelsAbove(int minimalInterestingDepth);
 
-    // simple collision detection
-    void registerForCollision(Actor *actor) { collideableActors.insert(actor); }
+    // Chunks touching the areas are generated on every kept layer, usually around the player and the camera.
+    // Chunks further than evictionDistance tiles from all of the areas are unloaded unless they were modified
+    void setStreamingAreas(std::vector<StreamingArea> areas) { streamingAreas = std::move(areas); }
+    void setEvictionDistance(int distance) { evictionDistance = distance; }
+
+    // Without a focus every actor is updated every tick. Actors updated less often get the time they missed
+    void setSimulationFocus(const std::optional<SimulationFocus> &focus) { simulationFocus = focus; }
+    // the actor is updated in the next tick wherever it is, for actors something has happened to
+    void promoteActor(Actor &actor);
 
-    void unregisterForCollision(Actor *actor) { collideableActors.erase(actor); }
+    // simple collision detection, registered actors are circles of radius getSize() on their layers
+    void registerForCollision(Actor *actor) { collisionGrid.insert(actor); }
 
-    const std::vector<Actor *> &queryPoint(glm::vec3 point);
+    void unregisterForCollision(Actor *actor) { collisionGrid.remove(actor); }
+
+    // registered actors of the kinds hit by the shape on its layer, written into result
+    void queryPoint(glm::vec3 point, std::vector<Actor *> &result, ActorKindMask kinds = AnyActorKind) const
+    {
+        collisionGrid.queryPoint(point, result, kinds);
+    }
+    void queryCircle(glm::vec3 center, float radius, std::vector<Actor *> &result,
+                     ActorKindMask kinds = AnyActorKind) const
+    {
+        collisionGrid.queryCircle(center, radius, result, kinds);
+    }
+    void queryRect(int depth, glm::vec2 from, glm::vec2 to, std::vector<Actor *> &result,
+                   ActorKindMask kinds = AnyActorKind) const
+    {
+        collisionGrid.queryRect(depth, from, to, result, kinds);
+    }
 
     size_t getFrameStamp() const { return frameStamp; }
 
 private:
-    void onLayerLoaded(const LevelLayer &layer);
-    void callOnReadyForActor(const std::shared_ptr<Actor> &actor, const LevelLayer &layer);
-    void callOnDestroyForActor(const std::shared_ptr<Actor> &actor);
+    void streamChunks();
+    // before the actors, they only read the fields
+    void updateFlowFields();
+    // updates the actors against the world as it was before the tick
+    void updateActors(float dt);
+    // then applies what they asked for, tile edits are queued
+    void applyActorCommands();
+    // Queued tile edits in the order they were asked for, as many as fit into EditedTilesPerTick.
+    // Edits of an actor in one tick are applied together, the budget never splits them
+    void applyTileEdits();
+    size_t getUpdatePeriod(const Actor &actor) const;
+    void applyCommands(const WorldCommands &commands);
+    // tries the waiting actors whose ground the chunk is part of
+    void onChunkLoaded(const LevelLayer &layer, glm::ivec2 chunk);
+    // onReady is called once the ground around the actor is loaded, false while the actor waits for it
+    bool tryMakeReady(Actor &actor);
+    void callOnDestroyForActor(Actor &actor);
 
 private:
-    struct UnavailableLevel{};
-    using Layer = std::variant<LevelLayer, std::future<LevelLayer>, UnavailableLevel>;
+    struct PendingChunk
+    {
+        glm::ivec2 position{0};
+        CancellationSource cancellation; // abandons generation when the chunk is dropped
+    };
+
+    using TileEdit = std::variant<WorldCommands::SetTile, WorldCommands::FillRound, WorldCommands::MoveTileDown>;
+
+    struct QueuedEdit
+    {
+        TileEdit edit;
+        size_t group = 0; // edits of one actor in one tick share it
+    };
+
+    struct TileEditHash
+    {
+        size_t operator()(const TileEdit &edit) const;
+    };
+
+    // fills of the tile around the center
+    struct QueuedFill
+    {
+        glm::ivec3 center{0};
+        Tile tile;
+
+        bool operator==(const QueuedFill &) const = default;
+    };
+
+    struct QueuedFillHash
+    {
+        size_t operator()(const QueuedFill &fill) const;
+    };
+
+    // chunks [first, last] of the ground around the position that have to be loaded before onReady
+    static std::pair<glm::ivec2, glm::ivec2> ReadyChunksOf(glm::vec3 position, glm::ivec2 layerSize);
+
+    // drops the edit when an equal one is queued already or a queued fill covers it
+    void queueTileEdit(const TileEdit &edit);
+    // once the edit is applied
+    void unqueueTileEdit(const TileEdit &edit);
+
+    struct TrackedActor
+    {
+        SlotHandle actor;
+        FlowField field;
+    };
+
+    struct LayerSlot
+    {
+        LevelLayer layer;
+        // chunks being generated, keyed like LevelLayer's ones
+        std::unordered_map<uint64_t, PendingChunk> pendingChunks;
+    };
+
+    // tiles around an actor that have to be loaded before its onReady
+    static constexpr int ActorReadyRadius = LevelLayer::ChunkSize / 2;
+    // consecutive actors updated by one job, each batch has its commands
+    static constexpr size_t ActorsPerBatch = 32;
+    // Ticks between updates of the actors in view, of the ones within FarDistance tiles of the views and DepthMargin
+    // layers of the visible ones, and of the rest. Actors of a tier are spread over its ticks by their handles
+    static constexpr std::array<size_t, 3> UpdatePeriods{1, 4, 16};
+    static constexpr float FarDistance = 128.0f;
+    static constexpr int DepthMargin = 4;
+    // Tiles actors may change per tick, an edit of a tick is applied whole even when it is over the budget alone.
+    // Counted in tiles rather than time, so that the world is the same however fast the machine is
+    static constexpr size_t EditedTilesPerTick = 256;
+    // edits of actors that start when as many are queued are dropped, duplicates are looked for among these
+    static constexpr size_t MaxPendingEdits = 1024;
+    // ahead of chunk generation, whose priorities aren't negative
+    static constexpr int ActorsUpdatePriority = -1;
 
     std::shared_ptr<WorldGenerator> generator;
+    std::shared_ptr<JobSystem> jobSystem;
 
     size_t maxLoadedLayers = 32;
     int firstLayerDepth = 0;
 
-    std::deque<Layer> layers;
+    std::deque<LayerSlot> layers;
+    // filled by generator workers, drained once per update. Shared, because workers may outlive the world
+    std::shared_ptr<MpscQueue<GeneratedChunk>> generatedChunks = std::make_shared<MpscQueue<GeneratedChunk>>();
+
+    std::vector<StreamingArea> streamingAreas;
+    // {depth, chunk key} of the chunks around the actors, sorted. Rebuilt by every update, the memory is kept
+    std::vector<std::pair<int, uint64_t>> actorChunks;
+    int evictionDistance = 2 * LevelLayer::ChunkSize;
+    std::optional<SimulationFocus> simulationFocus;
 
     size_t frameStamp = 0;
+    UpdateTimings lastUpdateTimings;
+    EditStats lastEditStats;
     ActorsList actors;
-    std::unordered_set<Actor*> collideableActors;
+    // applied batch by batch, kept between ticks
+    std::vector<WorldCommands> commandBatches;
+    // by the dense index of the actors, whether they are updated in this tick
+    std::vector<bool> dueActors;
+    std::deque<QueuedEdit> pendingEdits;
+    // The same edits, looked up to merge the ones asked for again, and the radii of the queued fills.
+    // Their nodes come from the pool, so that queueing an edit doesn't allocate once the pool has grown
+    std::pmr::unsynchronized_pool_resource editsMemory;
+    std::pmr::unordered_set<TileEdit, TileEditHash> queuedEdits{&editsMemory};
+    std::pmr::unordered_map<QueuedFill, std::pmr::vector<int>, QueuedFillHash> queuedFillRadii{&editsMemory};
+    size_t editGroup = 0, droppedGroup = std::numeric_limits<size_t>::max();
+    // in the order they were asked for, there are few of them
+    std::vector<TrackedActor> trackedActors;
+    // added actors whose ground isn't loaded yet, removed ones are dropped by the next chunk loaded
+    std::vector<SlotHandle> waitingActors;
+    CrowdGrid crowd;
+    // follows the actors once all of them have been updated
+    SpatialGrid collisionGrid;
+    ParticleSystem particles;
 };
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "ParticleSystem.h"
+#include "SlotMap.h"
+#include "Tile.h"
+
+class Actor;
+
+// Changes to the world an actor asks for while actors are updated in parallel and the world is only read.
+// The world applies them after the updates in the order of the actors, so the outcome doesn't depend on
+// the threads the actors were updated on
+class WorldCommands
+{
+public:
+    struct SetTile
+    {
+        glm::ivec3 position{0};
+        Tile tile;
+
+        bool operator==(const SetTile &) const = default;
+    };
+
+    struct FillRound
+    {
+        glm::ivec3 center{0};
+        int radius = 0;
+        Tile tile;
+
+        bool operator==(const FillRound &) const = default;
+    };
+
+    struct MoveTileDown
+    {
+        glm::ivec3 position{0};
+
+        bool operator==(const MoveTileDown &) const = default;
+    };
+
+    // commands after it are the ones of the next actor
+    struct BeginActor
+    {
+    };
+
+    struct AddActor
+    {
+        std::shared_ptr<Actor> actor;
+    };
+
+    struct SpawnProjectile
+    {
+        ParticleSystem::Particle particle, flash;
+        ParticleSystem::Explosion explosion;
+    };
+
+    struct Explode
+    {
+        ParticleSystem::Particle flash;
+        ParticleSystem::Explosion explosion;
+    };
+
+    struct TrackActor
+    {
+        SlotHandle actor;
+    };
+
+    using Command =
+        std::variant<SetTile, FillRound, MoveTileDown, BeginActor, AddActor, SpawnProjectile, Explode, TrackActor>;
+
+public:
+    // tiles of unloaded chunks are left as they are
+    void setTile(glm::ivec3 position, const Tile &tile) { commands.push_back(SetTile{position, tile}); }
+    void fillRoundArea(glm::ivec3 center, int radius, const Tile &tile = Tile::Empty())
+    {
+        commands.push_back(FillRound{center, radius, tile});
+    }
+    // the tile goes to the layer beneath and an empty one is left, the tile is read when the edit is applied
+    void moveTileDown(glm::ivec3 position) { commands.push_back(MoveTileDown{position}); }
+    // tile edits of an actor in one tick are applied together, see World::applyTileEdits
+    void beginActor() { commands.push_back(BeginActor{}); }
+    // the actor is updated from the next tick on
+    void addActor(std::shared_ptr<Actor> actor) { commands.push_back(AddActor{std::move(actor)}); }
+    // see ParticleSystem, the particles are dropped when the pool is full by then
+    void spawnProjectile(const ParticleSystem::Particle &particle, const ParticleSystem::Particle &flash,
+                         const ParticleSystem::Explosion &explosion)
+    {
+        commands.push_back(SpawnProjectile{particle, flash, explosion});
+    }
+    void explode(const ParticleSystem::Particle &flash, const ParticleSystem::Explosion &explosion)
+    {
+        commands.push_back(Explode{flash, explosion});
+    }
+    // see World::findFlowField, asking again for a tracked actor changes nothing
+    void trackActor(SlotHandle actor) { commands.push_back(TrackActor{actor}); }
+
+    // in the order they were asked for
+    std::span<const Command> getCommands() const { return commands; }
+    // keeps the memory for the next tick
+    void clear() { commands.clear(); }
+
+private:
+    std::vector<Command> commands;
+};
@@ -1,8 +1,41 @@
 #include "stdafx.h"
 #include "WorldGenerator.h"
+#include "DiscStamp.h"
+#include "JobSystem.h"
+#include "NoiseKernel.h"
 
-WorldGenerator::WorldGenerator(glm::uvec2 horizontalDimensions):
-    horizontalDimensions{horizontalDimensions}
+#include <cstdio>
+
+namespace
+{
+    constexpr TileClassId FirstOreClass = 3, LastOreClass = 10;
+    constexpr double OreThreshold = -0.98;
+    // Blocks of the ore pass. Smaller ones bound the field tighter but cost more bounds, about as
+    // much as sampling all of their tiles at 2x2
+    constexpr int OreBlockSize = 6;
+
+    // splitmix64 finalizer: neighbouring inputs give unrelated outputs
+    uint64_t MixSeed(uint64_t seed, uint64_t value)
+    {
+        uint64_t z = seed + 0x9e3779b97f4a7c15ull * (value + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // libnoise adds the octave number to the seed of a module, keep it far from overflowing
+    int MakeModuleSeed(uint64_t seed, uint64_t module) { return static_cast<int>(MixSeed(seed, module) & 0x3fffffff); }
+} // namespace
+
+struct WorldGenerator::RowBuffers
+{
+    std::vector<double> xs, values, ridgedValues;
+    std::vector<int> columns;
+    std::vector<uint8_t> needsOre, mayHaveOre;
+};
+
+WorldGenerator::WorldGenerator(glm::uvec2 horizontalDimensions, uint64_t seed, std::shared_ptr<JobSystem> jobSystem):
+    horizontalDimensions{horizontalDimensions}, seed{seed}, jobSystem{std::move(jobSystem)}
 {
     tileClasses.emplace_back(0, "empty"s, 0, 0, false);
     tileClasses.emplace_back(1, "dirt"s, 5);
@@ -15,86 +48,300 @@ WorldGenerator::WorldGenerator(glm::uvec2 horizontalDimensions):
     tileClasses.emplace_back(8, "gold_ore"s, 3, 2);
     tileClasses.emplace_back(9, "mineral_ruby"s, 10, 10);
     tileClasses.emplace_back(10, "fuel"s, 1);
+
+    for (const auto &tileClass : tileClasses)
+        solidity[tileClass.id] = tileClass.isSolid;
+
+    noise.SetSeed(MakeModuleSeed(seed, 0));
+
+    rmf.SetOctaveCount(4);
+    rmf.SetFrequency(0.2);
+    rmf.SetSeed(MakeModuleSeed(seed, 1));
+
+    add.SetSourceModule(0, noise);
+    add.SetSourceModule(1, rmf);
+
+    smallNoise.SetFrequency(0.7);
+    smallNoise.SetOctaveCount(2);
+    smallNoise.SetSeed(MakeModuleSeed(seed, 2));
+
+    if (NoiseKernel::Instance().isAccurate())
+        noiseBackend = NoiseBackend::BatchKernel;
+}
+
+std::mt19937 WorldGenerator::makeRandomStream(int depth, glm::ivec2 chunk) const
+{
+    // the first streams are taken by the noise modules
+    const uint64_t depthSeed = MixSeed(seed, 0x100 + static_cast<uint32_t>(depth));
+    const uint64_t chunkSeed = MixSeed(depthSeed, (uint64_t{static_cast<uint32_t>(chunk.y)} << 32) | static_cast<uint32_t>(chunk.x));
+
+    std::seed_seq sequence{static_cast<uint32_t>(chunkSeed), static_cast<uint32_t>(chunkSeed >> 32)};
+    return std::mt19937{sequence};
+}
+
+Tile WorldGenerator::classifyTerrain(double value) const
+{
+    if (value < -0.3)
+        return Tile{tileClasses[2]};
+    if (value < 0.4)
+        return Tile{tileClasses[1]};
+
+    return Tile::Empty();
+}
+
+Tile WorldGenerator::generateTile(glm::ivec2 pos, double depth) const
+{
+    // std::uniform_int_distribution<int> distr_tileClass{0, 5};
+
+    auto val = add.GetValue(pos.x * 0.1, pos.y * 0.1, depth);
+
+    Tile tile = classifyTerrain(val);
+
+    if (tileClasses[tile.classId].isSolid)
+    {
+
+        for (TileClassId i = FirstOreClass; i <= LastOreClass; ++i)
+        {
+            const auto frequency = i * 0.02f;
+            const auto x = smallNoise.GetValue(pos.x * frequency, pos.y * frequency, depth + 1000 * i);
+            if (x < OreThreshold)
+            {
+                tile = tileClasses[i];
+                break;
+            }
+        }
+    }
+
+    /*
+    if (val < -0.6)
+        tile.classId = 5;
+    else if (val < -0.3)
+        tile.classId = 3;
+    else if (val < 0.4)
+        tile.classId = 2;
+        */
+
+    return tile;
 }
 
-void WorldGenerator::generateLevelLayer(LevelLayer& currentLayer)
+void WorldGenerator::generateRow(glm::ivec2 start, double depth, std::span<Tile> row, RowBuffers &buffers) const
 {
-    static noise::module::Perlin noise; 
-    static noise::module::RidgedMulti rmf;
-    static noise::module::Perlin smallNoise;
+    const auto &kernel = NoiseKernel::Instance();
+    const auto width = row.size();
 
-    static noise::module::Add add;
+    buffers.xs.resize(width);
+    buffers.values.resize(width);
+    buffers.ridgedValues.resize(width);
 
-    [&]() {
-        rmf.SetOctaveCount(4);
-        rmf.SetFrequency(0.2);
+    // add = noise + rmf
+    for (size_t x = 0; x < width; ++x)
+        buffers.xs[x] = (start.x + static_cast<int>(x)) * 0.1;
 
-        add.SetSourceModule(0, noise);
-        add.SetSourceModule(1, rmf);
+    kernel.perlin(NoiseKernel::PerlinParams::From(noise), buffers.xs, start.y * 0.1, depth, buffers.values);
+    kernel.ridgedMulti(NoiseKernel::RidgedMultiParams::From(rmf), buffers.xs, start.y * 0.1, depth,
+                       buffers.ridgedValues);
 
-        smallNoise.SetFrequency(0.7);
-        smallNoise.SetOctaveCount(2);
-    }();
+    for (size_t x = 0; x < width; ++x)
+        row[x] = classifyTerrain(buffers.values[x] + buffers.ridgedValues[x]);
+}
 
-    const auto depth = static_cast<double>(currentLayer.getDepth()) * 1.2;
+void WorldGenerator::placeOres(glm::ivec2 origin, glm::ivec2 size, double depth, std::span<Tile> tiles,
+                               RowBuffers &buffers) const
+{
+    const auto &kernel = NoiseKernel::Instance();
+    const auto params = NoiseKernel::PerlinParams::From(smallNoise);
 
-    currentLayer.visit([&, this](glm::ivec2 pos, Tile &tile) {
-        // std::uniform_int_distribution<int> distr_tileClass{0, 5};
+    auto tileIndex = [&](int x, int y) { return static_cast<size_t>(y) * size.x + x; };
 
-        auto val = add.GetValue(pos.x * 0.1, pos.y * 0.1, depth);
+    buffers.needsOre.resize(tiles.size());
+    for (size_t index = 0; index < tiles.size(); ++index)
+        buffers.needsOre[index] = tileClasses[tiles[index].classId].isSolid;
+
+    // the first ore whose field dips below the threshold wins, as in generateTile
+    for (TileClassId i = FirstOreClass; i <= LastOreClass; ++i)
+    {
+        const auto frequency = i * 0.02f;
+        const double z = depth + 1000 * i;
 
-        tile = Tile::Empty();
-        if (val < -0.3) 
-            tile = Tile{tileClasses[2]};
-        else if (val < 0.4)
-            tile = Tile{tileClasses[1]};
+        // Ore fields dip below the threshold in small rare spots. Blocks whose lower bound stays above it
+        // can't get this ore and are skipped, the rest is split once and then sampled tile by tile
+        const NoiseKernel::PerlinBounds bounds{kernel, params, {origin.x * frequency, origin.y * frequency},
+                                               {(origin.x + size.x - 1) * frequency, (origin.y + size.y - 1) * frequency},
+                                               z};
+        buffers.mayHaveOre.assign(buffers.needsOre.size(), false);
+        auto refine = [&](auto &self, glm::ivec2 from, glm::ivec2 to, int level) -> void {
+            bool anyNeeded = false;
+            for (int y = from.y; y < to.y && !anyNeeded; ++y)
+                for (int x = from.x; x < to.x && !anyNeeded; ++x)
+                    anyNeeded = buffers.needsOre[tileIndex(x, y)];
+            if (!anyNeeded)
+                return;
 
-        if (tileClasses[tile.classId].isSolid)
+            // the same float products generateTile samples at, rounding keeps them inside of the box
+            const glm::dvec2 sampleFrom{(origin.x + from.x) * frequency, (origin.y + from.y) * frequency};
+            const glm::dvec2 sampleTo{(origin.x + to.x - 1) * frequency, (origin.y + to.y - 1) * frequency};
+            if (bounds.lowerBound(sampleFrom, sampleTo) - NoiseKernel::Tolerance >= OreThreshold)
+                return;
+
+            const auto blockSize = to - from;
+            if (level == 0 || (blockSize.x < 2 && blockSize.y < 2))
+            {
+                for (int y = from.y; y < to.y; ++y)
+                    for (int x = from.x; x < to.x; ++x)
+                        buffers.mayHaveOre[tileIndex(x, y)] = true;
+                return;
+            }
+
+            const auto middle = from + glm::max(blockSize / 2, glm::ivec2{1});
+            self(self, from, glm::min(middle, to), level - 1);
+            if (middle.x < to.x)
+                self(self, {middle.x, from.y}, {to.x, std::min(middle.y, to.y)}, level - 1);
+            if (middle.y < to.y)
+                self(self, {from.x, middle.y}, {std::min(middle.x, to.x), to.y}, level - 1);
+            if (middle.x < to.x && middle.y < to.y)
+                self(self, middle, to, level - 1);
+        };
+
+        for (int blockY = 0; blockY < size.y; blockY += OreBlockSize)
+            for (int blockX = 0; blockX < size.x; blockX += OreBlockSize)
+            {
+                refine(refine, {blockX, blockY},
+                       {std::min(blockX + OreBlockSize, size.x), std::min(blockY + OreBlockSize, size.y)}, 1);
+            }
+
+        // exact values only for the tiles left, still a row at a time
+        for (int y = 0; y < size.y; ++y)
         {
+            buffers.xs.clear();
+            buffers.columns.clear();
+            for (int x = 0; x < size.x; ++x)
+            {
+                if (buffers.needsOre[tileIndex(x, y)] && buffers.mayHaveOre[tileIndex(x, y)])
+                {
+                    buffers.xs.push_back((origin.x + x) * frequency);
+                    buffers.columns.push_back(x);
+                }
+            }
+            if (buffers.xs.empty())
+                continue;
+
+            buffers.values.resize(buffers.xs.size());
+            kernel.perlin(params, buffers.xs, (origin.y + y) * frequency, z, buffers.values);
 
-            for (TileClassId i = 3; i <= 10; ++i)
+            for (size_t k = 0; k < buffers.columns.size(); ++k)
             {
-                const auto frequency = i * 0.02f;
-                const auto x = smallNoise.GetValue(pos.x * frequency, pos.y * frequency, depth + 1000 * i);
-                if (x < -0.98)
+                if (buffers.values[k] < OreThreshold)
                 {
-                    tile = tileClasses[i];
-                    break;
+                    const int x = buffers.columns[k];
+                    tiles[tileIndex(x, y)] = tileClasses[i];
+                    buffers.needsOre[tileIndex(x, y)] = false;
                 }
             }
         }
+    }
+}
 
-        /*
-        if (val < -0.6)
-            tile.classId = 5;
-        else if (val < -0.3)
-            tile.classId = 3;
-        else if (val < 0.4)
-            tile.classId = 2;
-            */
-    });
+bool WorldGenerator::generateChunk(int depth, glm::ivec2 chunk, std::vector<Tile> &tiles,
+                                   const CancellationToken &cancellation) const
+{
+    constexpr int chunkSize = LevelLayer::ChunkSize;
+
+    const auto origin = chunk * chunkSize;
+    const auto noiseDepth = static_cast<double>(depth) * 1.2;
+    tiles.resize(chunkSize * chunkSize);
+
+    if (noiseBackend == NoiseBackend::LibNoise)
+    {
+        for (int y = 0; y < chunkSize && !cancellation.isCancelled(); ++y)
+            for (int x = 0; x < chunkSize; ++x)
+                tiles[y * chunkSize + x] = generateTile(origin + glm::ivec2{x, y}, noiseDepth);
+        return !cancellation.isCancelled();
+    }
+
+    RowBuffers buffers;
+    for (int y = 0; y < chunkSize && !cancellation.isCancelled(); ++y)
+        generateRow(origin + glm::ivec2{0, y}, noiseDepth, std::span{tiles}.subspan(y * chunkSize, chunkSize), buffers);
+
+    if (cancellation.isCancelled())
+        return false;
+
+    placeOres(origin, glm::ivec2{chunkSize}, noiseDepth, tiles, buffers);
+    return true;
 }
 
-std::future<LevelLayer> WorldGenerator::generateLevelLayerAsync(int depth)
+bool WorldGenerator::generateLevelLayer(LevelLayer& currentLayer, const CancellationToken &cancellation)
 {
-    return std::async(std::launch::async, [generator = shared_from_this(), depth]() mutable {
-        LevelLayer replacementLayer{generator->horizontalDimensions, depth};
-        replacementLayer.setData(std::vector<Tile>{generator->horizontalDimensions.x * generator->horizontalDimensions.y});
+    const auto chunksCount = currentLayer.getChunksCount();
+    const auto numChunks = static_cast<size_t>(chunksCount.x) * chunksCount.y;
 
-        generator->generateLevelLayer(replacementLayer);
+    // chunks are generated into their own buffers, so the result doesn't depend on scheduling.
+    // Helpers go before queued chunks: finishing a started layer is more useful than starting something new
+    std::vector<std::vector<Tile>> chunks(numChunks);
+    auto generate = [&](size_t index) {
+        const auto chunk = glm::ivec2{static_cast<int>(index % chunksCount.x), static_cast<int>(index / chunksCount.x)};
+        generateChunk(currentLayer.getDepth(), chunk, chunks[index], cancellation);
+    };
 
-        return replacementLayer;
-    });
+    // without workers the chunks are generated one by one on the calling thread, like generateChunkAsync does
+    if (const auto jobs = jobSystem.lock())
+        jobs->parallelFor(numChunks, generate, std::numeric_limits<int>::min());
+    else
+    {
+        for (size_t index = 0; index < numChunks && !cancellation.isCancelled(); ++index)
+            generate(index);
+    }
+
+    if (cancellation.isCancelled())
+        return false;
+
+    for (size_t index = 0; index < numChunks; ++index)
+    {
+        const auto chunk = glm::ivec2{static_cast<int>(index % chunksCount.x), static_cast<int>(index / chunksCount.x)};
+        currentLayer.setChunk(chunk, chunks[index]);
+    }
+    return true;
+}
+
+void WorldGenerator::generateChunkAsync(int depth, glm::ivec2 chunk, int priority, CancellationToken cancellation,
+                                        ChunkCallback onGenerated)
+{
+    auto generate = [generator = shared_from_this(), depth, chunk, cancellation,
+                     onGenerated = std::move(onGenerated)]()
+    {
+        if (cancellation.isCancelled())
+            return;
+
+        GeneratedChunk generated{depth, chunk};
+        try
+        {
+            if (!generator->generateChunk(depth, chunk, generated.tiles, cancellation))
+                return;
+        }
+        catch (const std::exception &error)
+        {
+            // the world asks for the chunk again instead of waiting for it forever
+            std::fprintf(stderr, "chunk {%d, %d} of layer %d failed: %s\n", chunk.x, chunk.y, depth, error.what());
+            generated.tiles.clear();
+            generated.failed = true;
+        }
+        onGenerated(std::move(generated));
+    };
+
+    // without workers the chunk is generated right away, it still arrives through the callback
+    if (const auto jobs = jobSystem.lock())
+        jobs->submit(std::move(generate), priority);
+    else
+        generate();
 }
 
 
 
 void FillRoundArea(LevelLayer &layer, glm::ivec2 center, int radius, Tile fillingTile)
 {
-    layer.visit([=](glm::ivec2 pos, Tile &tile)
+    DiscStamp::Get(radius).apply(layer, center, [&](glm::ivec2, std::span<TileClassId> classes,
+                                                    std::span<int16_t> strengths)
     {
-        if (auto dir = center - pos; sqrt(dir.x * dir.x + dir.y * dir.y) <= radius)
-            tile = fillingTile;
-
-    }, center - glm::ivec2{radius}, center + glm::ivec2{radius});
+        std::ranges::fill(classes, fillingTile.classId);
+        std::ranges::fill(strengths, fillingTile.actualStrength);
+    });
 }
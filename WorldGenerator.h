@@ -3,20 +3,78 @@
 #include "World.h"
 #include <noise/noise.h>
 
+class JobSystem;
+
 class WorldGenerator : public std::enable_shared_from_this<WorldGenerator>
 {
 public:
-    WorldGenerator(glm::uvec2 horizontalDimensions);
+    enum class NoiseBackend
+    {
+        LibNoise,   // scalar, per tile virtual calls
+        BatchKernel // NoiseKernel rows, agrees with libnoise within NoiseKernel::Tolerance
+    };
+
+public:
+    // The same seed gives the same world whatever the number of workers or the order layers are requested in
+    WorldGenerator(glm::uvec2 horizontalDimensions, uint64_t seed, std::shared_ptr<JobSystem> jobSystem);
+
+    // noise modules reference each other
+    WorldGenerator(const WorldGenerator &) = delete;
+    WorldGenerator &operator=(const WorldGenerator &) = delete;
 
     glm::uvec2 getLayerDimensions() const { return horizontalDimensions; }
-    void generateLevelLayer(LevelLayer &currentLayer);
-    std::future<LevelLayer> generateLevelLayerAsync(int depth);
+    uint64_t getSeed() const { return seed; }
+
+    // Random numbers of a depth and a chunk of it. Derived only from the seed and the arguments,
+    // so every stream can be recreated on any thread in any order
+    std::mt19937 makeRandomStream(int depth, glm::ivec2 chunk = {}) const;
+
+    // LevelLayer::ChunkSize squared tiles of the chunk, row by row. Chunks are independent of each other and
+    // of the layer size. Returns false if generation was cancelled
+    bool generateChunk(int depth, glm::ivec2 chunk, std::vector<Tile> &tiles,
+                       const CancellationToken &cancellation = {}) const;
+    // Generates every chunk of the layer on the job system, on the calling thread once it is gone.
+    // Returns false if generation was cancelled, the layer is left untouched then
+    bool generateLevelLayer(LevelLayer &currentLayer, const CancellationToken &cancellation = {});
+    // onGenerated is called from a worker thread, or before the return when the job system is gone; lower priority
+    // value is generated earlier. Cancelled chunks are never reported, failed ones are reported without tiles
+    using ChunkCallback = std::function<void(GeneratedChunk &&chunk)>;
+    void generateChunkAsync(int depth, glm::ivec2 chunk, int priority, CancellationToken cancellation,
+                            ChunkCallback onGenerated);
 
     std::span<const TileClass> getClasses() const { return tileClasses; }
+    const TileSolidity &getSolidity() const { return solidity; }
+
+    // BatchKernel is the default one when the kernel passed its self check
+    void setNoiseBackend(NoiseBackend backend) { noiseBackend = backend; }
+    NoiseBackend getNoiseBackend() const { return noiseBackend; }
+
+ private:
+    struct RowBuffers;
+
+    // pure functions of position, so chunks can be generated in any order and on any thread
+    Tile generateTile(glm::ivec2 pos, double depth) const;
+    void generateRow(glm::ivec2 start, double depth, std::span<Tile> row, RowBuffers &buffers) const;
+    // ore pass of the kernel backend over size.x * size.y tiles starting at origin, row by row
+    void placeOres(glm::ivec2 origin, glm::ivec2 size, double depth, std::span<Tile> tiles,
+                   RowBuffers &buffers) const;
+
+    Tile classifyTerrain(double value) const;
 
  private:
+    // configured once in the constructor and only read afterwards
+    noise::module::Perlin noise;
+    noise::module::RidgedMulti rmf;
+    noise::module::Perlin smallNoise;
+    noise::module::Add add;
+
     glm::uvec2 horizontalDimensions;
+    uint64_t seed = 0;
     std::vector<TileClass> tileClasses;
+    TileSolidity solidity{};
+    // weak: queued jobs keep the generator alive, so owning the pool would let a worker destroy it
+    std::weak_ptr<JobSystem> jobSystem;
+    NoiseBackend noiseBackend = NoiseBackend::LibNoise;
 
 };
 
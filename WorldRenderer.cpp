@@ -9,6 +9,7 @@ void LayerRenderer::setLayer(const LevelLayer *layer)
         return;
 
     currentLayer = layer;
+    meshes.clear();
     lastKnownRevision = -1;
 }
 
@@ -30,7 +31,7 @@ void LayerRenderer::setBaseColor(sf::Color color)
     lastKnownRevision = -1;
 }
 
-void LayerRenderer::update(bool force)
+void LayerRenderer::update(bool force, std::pmr::memory_resource *scratch)
 {
     if (!currentLayer || !textureAtlas)
         return;
@@ -38,30 +39,109 @@ void LayerRenderer::update(bool force)
     if (!force && lastKnownRevision == currentLayer->getRevision() && lastKnownRevision != -1)
         return;
 
+    // without the log of the changes since the last update every chunk is rebuilt
+    const auto dirtyRects = force || lastKnownRevision == -1
+                                ? std::nullopt
+                                : currentLayer->getDirtyRectsSince(lastKnownRevision);
     lastKnownRevision = currentLayer->getRevision();
 
-    const size_t bufferLength = currentLayer->getSize().x * currentLayer->getSize().y * 4;
-    vertexArray.resize(bufferLength);
-    
-    size_t baseVertexIndex = 0;
-    currentLayer->visit([&](glm::ivec2 pos, const Tile &tile) {
-        const auto& region = textureAtlas->regions[tile.classId];
-        const auto bottom = region.top + region.height;
-        const auto right = region.left + region.width;
+    std::erase_if(meshes, [this](const auto &entry) {
+        return entry.second.loadRevision != currentLayer->getChunkLoadRevision(entry.second.chunk);
+    });
 
-        const glm::vec2 lt = glm::vec2{pos} - 8.0f/12, bd = glm::vec2{pos} + 8.0f / 12;
+    for (const auto chunk : currentLayer->getLoadedChunks(scratch))
+    {
+        const auto [found, inserted] = meshes.try_emplace(LevelLayer::ChunkKey(chunk));
+        if (!inserted && dirtyRects)
+            continue;
 
-        vertexArray[baseVertexIndex+0] = sf::Vertex{{lt.x, lt.y}, baseColor, sf::Vector2f{region.left, region.top}};
-        vertexArray[baseVertexIndex+1] = sf::Vertex{{bd.x, lt.y}, baseColor, sf::Vector2f{right, region.top}};
-        vertexArray[baseVertexIndex+2] = sf::Vertex{{bd.x, bd.y}, baseColor, sf::Vector2f{right,bottom}};
-        vertexArray[baseVertexIndex+3] = sf::Vertex{{lt.x, bd.y}, baseColor, sf::Vector2f{region.left, bottom}};
+        auto &mesh = found->second;
+        mesh.chunk = chunk;
+        mesh.loadRevision = currentLayer->getChunkLoadRevision(chunk);
+        buildChunk(mesh);
+    }
+
+    if (!dirtyRects)
+        return;
 
+    for (const auto &rect : *dirtyRects)
+    {
+        const auto firstChunk = LevelLayer::ChunkOf(rect.from), lastChunk = LevelLayer::ChunkOf(rect.to - 1);
+        for (auto cy = firstChunk.y; cy <= lastChunk.y; ++cy)
+        for (auto cx = firstChunk.x; cx <= lastChunk.x; ++cx)
+        {
+            const auto found = meshes.find(LevelLayer::ChunkKey({cx, cy}));
+            // meshes built in this update already have the change
+            if (found == meshes.end() || found->second.builtRevision >= rect.revision)
+                continue;
+
+            const auto origin = glm::ivec2{cx, cy} * LevelLayer::ChunkSize;
+            updateChunkRect(found->second, max(rect.from, origin), min(rect.to, origin + LevelLayer::ChunkSize));
+        }
+    }
+}
+
+void LayerRenderer::makeQuad(size_t baseVertexIndex, glm::ivec2 pos, TileClassId classId)
+{
+    const auto& region = textureAtlas->regions[classId];
+    const auto bottom = region.top + region.height;
+    const auto right = region.left + region.width;
+
+    const glm::vec2 lt = glm::vec2{pos} - 8.0f/12, bd = glm::vec2{pos} + 8.0f / 12;
+
+    vertexArray[baseVertexIndex+0] = sf::Vertex{{lt.x, lt.y}, baseColor, sf::Vector2f{region.left, region.top}};
+    vertexArray[baseVertexIndex+1] = sf::Vertex{{bd.x, lt.y}, baseColor, sf::Vector2f{right, region.top}};
+    vertexArray[baseVertexIndex+2] = sf::Vertex{{bd.x, bd.y}, baseColor, sf::Vector2f{right,bottom}};
+    vertexArray[baseVertexIndex+3] = sf::Vertex{{lt.x, bd.y}, baseColor, sf::Vector2f{region.left, bottom}};
+}
+
+void LayerRenderer::buildChunk(ChunkMesh &mesh)
+{
+    vertexArray.resize(LevelLayer::ChunkSize * LevelLayer::ChunkSize * 4);
+
+    // only the class plane is read, strengths don't show
+    const auto classes = currentLayer->getChunkClasses(mesh.chunk);
+    const auto from = mesh.chunk * LevelLayer::ChunkSize;
+    const auto to = min(from + LevelLayer::ChunkSize, currentLayer->getSize());
+
+    size_t baseVertexIndex = 0;
+    for (int y = from.y; y < to.y; ++y)
+    for (int x = from.x; x < to.x; ++x)
+    {
+        makeQuad(baseVertexIndex, {x, y}, classes[(y - from.y) * LevelLayer::ChunkSize + (x - from.x)]);
         baseVertexIndex += 4;
-    });
+    }
+
+    mesh.width = std::max(to.x - from.x, 0);
+    mesh.builtRevision = currentLayer->getRevision();
 
-    if (vertexBuffer.getVertexCount() != vertexArray.getVertexCount())
-        vertexBuffer.create(vertexArray.getVertexCount());
-    vertexBuffer.update(&vertexArray[0], vertexArray.getVertexCount(), 0);
+    if (mesh.vertexBuffer.getVertexCount() != baseVertexIndex)
+        mesh.vertexBuffer.create(baseVertexIndex);
+    if (baseVertexIndex != 0)
+        mesh.vertexBuffer.update(&vertexArray[0], baseVertexIndex, 0);
+}
+
+void LayerRenderer::updateChunkRect(ChunkMesh &mesh, glm::ivec2 from, glm::ivec2 to)
+{
+    const auto classes = currentLayer->getChunkClasses(mesh.chunk);
+    const auto origin = mesh.chunk * LevelLayer::ChunkSize;
+    to = min(to, currentLayer->getSize());
+    if (from.x >= to.x)
+        return;
+
+    vertexArray.resize(LevelLayer::ChunkSize * 4);
+    for (int y = from.y; y < to.y; ++y)
+    {
+        size_t baseVertexIndex = 0;
+        for (int x = from.x; x < to.x; ++x)
+        {
+            makeQuad(baseVertexIndex, {x, y}, classes[(y - origin.y) * LevelLayer::ChunkSize + (x - origin.x)]);
+            baseVertexIndex += 4;
+        }
+
+        const auto offset = ((y - origin.y) * mesh.width + (from.x - origin.x)) * 4;
+        mesh.vertexBuffer.update(&vertexArray[0], baseVertexIndex, static_cast<unsigned>(offset));
+    }
 }
 
 void LayerRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) const
@@ -70,7 +150,8 @@ void LayerRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) cons
         return;
 
     states.texture = &textureAtlas->texture;
-    target.draw(vertexBuffer, states);
+    for (const auto &[key, mesh] : meshes)
+        target.draw(mesh.vertexBuffer, states);
 }
 
 WorldRenderer::WorldRenderer(World &world, TextureAtlas &tilesAtlas) : world{world}, tilesAtlas{tilesAtlas}
@@ -101,12 +182,28 @@ void WorldRenderer::setVisibleLayers(int _topLayer, int _numLayers)
 
 void WorldRenderer::update()
 {
+    frameArena.reset();
     for (auto& renderer : renderers)
     {
-        renderer.update();
+        renderer.update(false, &frameArena);
     }
 }
 
+std::optional<std::pair<glm::vec2, glm::vec2>> WorldRenderer::getVisibleTiles(int depth, glm::vec2 windowSize) const
+{
+    const auto index = depth - topLayer;
+    if (index < 0 || index >= static_cast<int>(renderers.size()))
+        return std::nullopt;
+
+    // the corners of the window where the layer is scaled around the camera
+    const auto halfSize = windowSize / (2.0f * LayerScale(index));
+    const auto camera = to_glm(cameraPosition);
+    const auto corner = to_glm(getInverseTransform().transformPoint(camera.x - halfSize.x, camera.y - halfSize.y));
+    const auto oppositeCorner =
+        to_glm(getInverseTransform().transformPoint(camera.x + halfSize.x, camera.y + halfSize.y));
+    return std::pair{min(corner, oppositeCorner), max(corner, oppositeCorner)};
+}
+
 void WorldRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) const
 {
     const auto originalTransform = states.transform *= getTransform();
@@ -115,7 +212,7 @@ void WorldRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) cons
     {
         auto &renderer = renderers[depth];
 
-        const auto scaleFactor = 1.0f / static_cast<float>((depth-1) * 0.05f + 1);
+        const auto scaleFactor = LayerScale(depth);
 
         sf::Transform transform;
         transform.translate(cameraPosition);
@@ -130,7 +227,18 @@ void WorldRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) cons
         };
 
         for (const auto &actor : world.getActors() | std::ranges::views::filter(actorShouldBeRendered))
-            target.draw(*actor, states);
+        {
+            // actors the world updates less often than every tick move over all of the ticks in between
+            const auto interval = actor->getUpdateInterval();
+            const auto fraction = interval > 0.0f
+                ? std::min((actor->getSkippedTime() + interpolation * tickDuration) / interval, 1.0f)
+                : interpolation;
+            const auto position = mix(actor->getPreviousPosition(), actor->getPosition(), fraction);
+            actorRenderer.draw(target, states, *actor, position);
+        }
+
+        if (renderer.getLayer())
+            drawParticles(target, states, renderer.getLayer()->getDepth() - 1);
     }
 
     //states.transform = originalTransform;
@@ -140,3 +248,51 @@ void WorldRenderer::draw(sf::RenderTarget &target, sf::RenderStates states) cons
     //        target.draw(*actor, states);
     //}
 }
+
+void WorldRenderer::drawParticles(sf::RenderTarget &target, sf::RenderStates states, int depth) const
+{
+    const auto &particles = world.getParticles();
+    const auto xs = particles.getPositionsX(), ys = particles.getPositionsY();
+    const auto depths = particles.getDepths(), sizes = particles.getSizes(), angles = particles.getAngles();
+    const auto velocitiesX = particles.getVelocitiesX(), velocitiesY = particles.getVelocitiesY();
+    const auto textures = particles.getTextures();
+
+    states.blendMode = sf::BlendMode{sf::BlendMode::SrcAlpha, sf::BlendMode::One};
+    for (size_t texture = 0; texture < particleTextures.size(); ++texture)
+    {
+        // sizes are of the longer side of the texture, the way sprites were scaled
+        const auto pixels = particleTextures[texture]->getSize();
+        const auto textureSize = glm::vec2{pixels.x, pixels.y};
+        const auto scale = 0.5f / std::max(textureSize.x, textureSize.y);
+
+        particleVertices.clear();
+        for (size_t i = 0; i < particles.getCount(); ++i)
+        {
+            if (textures[i] != texture || static_cast<int>(depths[i]) != depth)
+                continue;
+
+            const auto halfSize = textureSize * (sizes[i] * scale);
+            const auto angle = glm::radians(angles[i]);
+            const auto axisX = glm::vec2{cos(angle), sin(angle)} * halfSize.x;
+            const auto axisY = glm::vec2{-sin(angle), cos(angle)} * halfSize.y;
+            const auto center = glm::vec2{xs[i], ys[i]} - glm::vec2{velocitiesX[i], velocitiesY[i]} * timeToNextTick;
+            const auto color = sf::Color{255, 255, 255, static_cast<sf::Uint8>(255 * particles.getOpacity(i))};
+
+            auto addCorner = [&](glm::vec2 corner, glm::vec2 texCoords)
+            {
+                particleVertices.emplace_back(sf::Vector2f{corner.x, corner.y}, color,
+                                              sf::Vector2f{texCoords.x, texCoords.y});
+            };
+            addCorner(center - axisX - axisY, {0, 0});
+            addCorner(center + axisX - axisY, {textureSize.x, 0});
+            addCorner(center + axisX + axisY, textureSize);
+            addCorner(center - axisX + axisY, {0, textureSize.y});
+        }
+
+        if (particleVertices.empty())
+            continue;
+
+        states.texture = particleTextures[texture];
+        target.draw(particleVertices.data(), particleVertices.size(), sf::Quads, states);
+    }
+}
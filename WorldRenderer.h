@@ -1,6 +1,9 @@
 #pragma once
 
+#include "ActorRenderer.h"
+#include "FrameArena.h"
 #include "TextureAtlas.h"
+#include "Tile.h"
 
 class World;
 class LevelLayer;
@@ -14,10 +17,26 @@ public:
     void setAtlas(const TextureAtlas *atlas);
 
     void setBaseColor(sf::Color color);
-    void update(bool force = false);
+    // scratch holds the temporaries of the update
+    void update(bool force = false, std::pmr::memory_resource *scratch = std::pmr::get_default_resource());
 
     void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
+private:
+    struct ChunkMesh
+    {
+        glm::ivec2 chunk{0};
+        size_t loadRevision = 0;
+        size_t builtRevision = 0; // layer revision the vertices are up to date with
+        int width = 0;            // quads per row, chunks on the edge of the layer are cut by its size
+        sf::VertexBuffer vertexBuffer{sf::Quads};
+    };
+
+    void buildChunk(ChunkMesh &mesh);
+    // re-uploads only the quads of tiles [from, to) of the chunk, row by row
+    void updateChunkRect(ChunkMesh &mesh, glm::ivec2 from, glm::ivec2 to);
+    void makeQuad(size_t baseVertexIndex, glm::ivec2 pos, TileClassId classId);
+
 private:
     size_t lastKnownRevision = 0;
     const TextureAtlas *textureAtlas = nullptr;
@@ -25,7 +44,8 @@ private:
 
     sf::Color baseColor = sf::Color::White;
     sf::VertexArray vertexArray{sf::Quads};
-    sf::VertexBuffer vertexBuffer { sf::Quads};
+    // one per loaded chunk of the layer, rebuilt when its chunk is loaded and patched by dirty rectangles
+    std::unordered_map<uint64_t, ChunkMesh> meshes;
 };
 
 class WorldRenderer final : public sf::Drawable, public sf::Transformable
@@ -36,16 +56,46 @@ public:
     void setCameraPosition(sf::Vector2f pos) { cameraPosition = pos; }
     void setVisibleLayers(int _topLayer, int _numLayers = 16);
 
+    // indexed by ParticleSystem::Particle::texture, the textures must outlive the renderer
+    void setParticleTextures(std::vector<const sf::Texture *> textures) { particleTextures = std::move(textures); }
+    // see ActorRenderer::setLooks
+    void setActorLooks(std::vector<ActorRenderer::Look> looks) { actorRenderer.setLooks(std::move(looks)); }
+
+    // Actors are drawn between their previous and current positions, over the time their last update covered.
+    // Particles move straight, they are moved back by their velocity for the rest of the tick
+    void setInterpolation(float fraction, float _tickDuration)
+    {
+        interpolation = fraction;
+        tickDuration = _tickDuration;
+        timeToNextTick = (1.0f - fraction) * tickDuration;
+    }
+
+    // Tiles [from, to) of the layer a window of the size shows around the camera, deeper layers are drawn smaller.
+    // Actors are drawn over the layer beneath them. Nothing for the layers that aren't drawn
+    std::optional<std::pair<glm::vec2, glm::vec2>> getVisibleTiles(int depth, glm::vec2 windowSize) const;
+
     void update();
     void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
+private:
+    // particles on the layer, one batch per texture
+    void drawParticles(sf::RenderTarget &target, sf::RenderStates states, int depth) const;
+    // of the layer drawn index-th from the top one, around the camera
+    static float LayerScale(int index) { return 1.0f / ((index - 1) * 0.05f + 1); }
+
 private:
     int topLayer = 0, numVisibleLayers = 0;
+    float interpolation = 1.0f, tickDuration = 0.0f, timeToNextTick = 0.0f;
 
     World &world;
     TextureAtlas &tilesAtlas;
     sf::Vector2f cameraPosition;
     std::vector<LayerRenderer> renderers;
+    FrameArena frameArena; // reset by every update
+    ActorRenderer actorRenderer;
+
+    std::vector<const sf::Texture *> particleTextures;
+    mutable std::vector<sf::Vertex> particleVertices; // kept between frames, so drawing doesn't allocate
 };
 
 template <typename T>
@@ -8,69 +8,129 @@
 #include "World.h"
 #include "Actor.h"
 
+#include "AllocationCounter.h"
+#include "DiscStamp.h"
+#include "FixedTimestep.h"
+#include "JobSystem.h"
 #include "WorldGenerator.h"
 
 namespace
 {
+    // harvested tiles per class
+    using ResourceSet = std::array<int, std::numeric_limits<TileClassId>::max() + 1>;
+
+    // tiles of the disc lose gatherForce of strength, the ones worn down to nothing are harvested and emptied
     void GatherResourcesAtRadius(LevelLayer &layer, glm::ivec2 center, int radius, int16_t gatherForce,
-                                 std::function<void(glm::ivec2, TileClassId)> onGather)
+                                 ResourceSet &harvest)
     {
-        layer.visit(
-            [=](glm::ivec2 pos, Tile &tile) {
-                if (auto dir = center - pos; sqrt(dir.x * dir.x + dir.y * dir.y) <= radius)
+        DiscStamp::Get(radius).apply(layer, center, [&](glm::ivec2, std::span<TileClassId> classes,
+                                                        std::span<int16_t> strengths)
+        {
+            for (size_t i = 0; i < classes.size(); ++i)
+            {
+                strengths[i] = static_cast<int16_t>(std::max(0, strengths[i] - gatherForce));
+                if (strengths[i] == 0)
                 {
-                    tile.actualStrength = std::max(0, tile.actualStrength - gatherForce);
-                    if (tile.actualStrength == 0)
-                    {
-                        onGather(pos, tile.classId);
-                        tile = Tile::Empty();
-                    }
+                    harvest[classes[i]]++;
+                    classes[i] = Tile::Empty().classId;
+                    strengths[i] = Tile::Empty().actualStrength;
                 }
-            },
-            center - glm::ivec2{radius}, center + glm::ivec2{radius});
+            }
+        });
     }
 
-    using ResourceSet = std::unordered_map<TileClassId, int>;
     ResourceSet HarvestResources(World &world, glm::ivec3 pos, int radius, int16_t gatherForce)
     {
-        std::unordered_map<TileClassId, int> harvest;
+        ResourceSet harvest{};
 
         auto *layer = world.getLayer(pos.z);
         if (layer)
-            GatherResourcesAtRadius(*layer, glm::xy(pos), radius, gatherForce, [&harvest](glm::ivec2, TileClassId tile) { harvest[tile]++;});
+            GatherResourcesAtRadius(*layer, glm::xy(pos), radius, gatherForce, harvest);
 
         return harvest;
     }
 
-    void HarvestToInventory(ResourceSet &&harvest, Tank::Inventory &inventory, std::span<const TileClass> classes)
+    void HarvestToInventory(const ResourceSet &harvest, Tank::Inventory &inventory, std::span<const TileClass> classes)
     {
-        for (auto [tileClassId, amount] : harvest)
+        for (size_t tileClassId = 0; tileClassId < std::min(harvest.size(), classes.size()); ++tileClassId)
         {
-            inventory.amountMinerals += classes[tileClassId].value;
+            if (harvest[tileClassId] > 0)
+                inventory.amountMinerals += classes[tileClassId].value;
         }
 
         inventory.amountOil += harvest[10];
     }
 
-    std::unique_ptr<Effect> MakeExplosionEffect(glm::vec3 position, int radius, const sf::Texture& texture, float gatherForce = 1.0f, float damage = 0.5f, std::shared_ptr<Tank> gatherer = {})
+    // indices of WorldRenderer's particle textures
+    enum ParticleTexture : uint8_t
+    {
+        FlameParticle,
+        GlowParticle
+    };
+
+    // indices of WorldRenderer's actor looks
+    enum ActorLook : uint8_t
+    {
+        TankLook,
+        BaseLook,
+        SmallEnemyLook,
+        BigEnemyLook
+    };
+
+    // ParticleSystem::explode moves it to the explosion
+    ParticleSystem::Particle MakeExplosionFlash()
+    {
+        ParticleSystem::Particle flash;
+        flash.lifetime = 0.1f;
+        flash.sizeVelocity = 200.0f;
+        flash.size = 4.0f;
+        flash.texture = FlameParticle;
+        return flash;
+    }
+
+    ParticleSystem::Explosion MakeExplosion(glm::vec3 position, int radius, float gatherForce = 1.0f,
+                                            float damage = 0.5f, SlotHandle gatherer = {})
+    {
+        ParticleSystem::Explosion explosion;
+        explosion.position = position;
+        explosion.radius = radius;
+        explosion.gatherForce = gatherForce;
+        explosion.damage = damage;
+        explosion.gatherer = gatherer;
+        return explosion;
+    }
+
+    // gameplay of an explosion the particles reported, contacts is a query buffer
+    void ApplyExplosion(World &world, const ParticleSystem::Explosion &explosion, std::vector<Actor *> &contacts)
     {
-        auto effect = std::make_unique<Effect>(position, glm::vec2{}, 0.1f, 0.0f, 200.0, 4.0f, [=](Effect &effect, World &world) {
-           if (auto *layer = world.getLayer(effect.getPosition().z))
-           {
-               auto harvest = HarvestResources(world, effect.getPosition(), radius, gatherForce);
-               if (gatherer)
-                HarvestToInventory(std::move(harvest), gatherer->inventory, world.getGenerator()->getClasses());
-           }
-
-            auto &collisions = world.queryPoint(effect.getPosition());
-            for (auto *object : collisions | std::ranges::views::filter([](auto *x) { return dynamic_cast<Character *>(x); }))
+        auto *gatherer = world.findActor(explosion.gatherer);
+
+        const auto harvest = HarvestResources(world, explosion.position, explosion.radius,
+                                              static_cast<int16_t>(explosion.gatherForce));
+        if (gatherer && gatherer->getKind() == ActorKind::Tank)
+            HarvestToInventory(harvest, static_cast<Tank *>(gatherer)->inventory, world.getGenerator()->getClasses());
+
+        world.queryPoint(explosion.position, contacts, CharacterKinds);
+        for (auto *object : contacts)
+        {
+            if (object != gatherer)
             {
-                if (object != gatherer.get())
-                    static_cast<Character *>(object)->damage(damage);
+                static_cast<Character *>(object)->damage(explosion.damage);
+                world.promoteActor(*object);
             }
-       });
-        effect->setTexture(texture);
-        return effect;
+        }
+    }
+
+    // for the window title, empty unless allocations are counted, see AllocationCounter.h
+    std::string AllocationsPerFrame(std::optional<size_t> &lastCount, size_t frames)
+    {
+        const auto count = GetAllocationsCount();
+        if (!count || !lastCount)
+            return {};
+
+        const auto perFrame = (*count - *lastCount) / std::max<size_t>(frames, 1);
+        lastCount = count;
+        return ", allocations/frame: "s + std::to_string(perFrame);
     }
 
     
@@ -79,10 +139,18 @@ namespace
 
 const static auto title = "Deep.Drill.Tank. "s; 
 
+// layers are streamed in chunks, only the explored part of them is kept in memory
+constexpr glm::uvec2 WorldSize{4096, 4096};
+const glm::vec2 WorldCenter = glm::vec2{WorldSize} / 2.0f;
+constexpr float TileScale = 12.0f;
+constexpr int PlayerStreamingRadius = 48;
+constexpr int VisibleLayersCount = 16;
+
 class App
 {
 public:
-    App ()
+    // a random world for every new game, unless the seed is given
+    explicit App(std::optional<uint64_t> seed = std::nullopt) : fixedSeed{seed}
     {
         
     }
@@ -96,10 +164,9 @@ public:
 
         auto prevTime = std::chrono::high_resolution_clock::now();
 
-        float averageDt = 0.0f;
-
         sf::Clock performanceCounterClock;
         size_t fps = 0;
+        auto lastAllocationsCount = GetAllocationsCount();
         while (window.isOpen())
         {
             // Process events
@@ -115,13 +182,16 @@ public:
             const float dt = std::chrono::duration_cast<std::chrono::microseconds>(newTime - prevTime).count() / 1000000.0f;
             prevTime = newTime;
 
-            averageDt = glm::mix(averageDt, dt, 0.01f);
-            Update(averageDt);
+            Update(dt);
             Render();
 
             if (performanceCounterClock.getElapsedTime().asSeconds() >= 1.0f)
             {
-                window.setTitle(title + std::to_string(fps) + " fps");
+                const auto jobStats = jobSystem->getStats();
+                window.setTitle(title + std::to_string(fps) + " fps, generator queue: "s +
+                                std::to_string(jobStats.queuedJobs) + ", avg latency: "s +
+                                std::to_string(jobStats.averageLatency.count() / 1000) + " ms, seed: "s +
+                                std::to_string(worldSeed) + AllocationsPerFrame(lastAllocationsCount, fps));
 
                 fps = 0;
                 performanceCounterClock.restart();
@@ -181,20 +251,34 @@ private:
 
         if (!font.loadFromFile("Resources/third-party/Nasa21-l23X.ttf"))
             throw std::runtime_error{"font could'nt be loaded"s};
+        resourcesText = sf::Text{"", font, 30};
+        gameOverText = sf::Text{"Game over", font, 80};
 
         StartNewGame();
     }
 
     void StartNewGame()
     {
+        if (fixedSeed)
+            worldSeed = *fixedSeed;
+        else
+        {
+            std::random_device device;
+            worldSeed = (uint64_t{device()} << 32) | device();
+        }
+
+        auto generator = std::make_shared<WorldGenerator>(WorldSize, worldSeed, jobSystem);
+        random = generator->makeRandomStream(0); // spawn positions
+
         world = std::make_unique<World>();
-        world->setGenerator(std::make_shared<WorldGenerator>(glm::uvec2{256, 256}));
+        world->setGenerator(std::move(generator));
+        world->setJobSystem(jobSystem);
 
         {
             baseActor = std::make_unique<Base>();
-            baseActor->setTexture(baseTexture);
+            baseActor->setLook(BaseLook);
             baseActor->setSize(15);
-            baseActor->setPosition({128, 128, 0.0});
+            baseActor->setPosition({WorldCenter, 0.0});
             baseActor->setHP(100.0);
 
             world->addActor(baseActor);
@@ -202,30 +286,32 @@ private:
 
         {
             playerActor = std::make_unique<Tank>();
-            playerActor->setTexture(tankTexture);
+            playerActor->setLook(TankLook);
             playerActor->setMaxSpeed(10.0f);
             playerActor->setSize(2);
-            playerActor->setPosition({128, 128, 0.0});
-            playerActor->setAdditionalTextures(tankTowerTexture, tankDrillTexture);
+            playerActor->setPosition({WorldCenter, 0.0});
 
             //cannon
             playerActor->getWeaponList().emplace_back(
-                [&](Character &instigator, glm::vec2 direction)
+                [](Character &instigator, glm::vec2 direction, WorldCommands &commands)
             {
-                auto bullet = std::make_unique<Bullet>(instigator.getPosition(), instigator.getVelocity() + direction * 100.0f);
-                bullet->setPosition(instigator.getPosition() +
-                    glm::vec3{direction * static_cast<float>(instigator.getSize() * 2.0f), 0.0f});
-                bullet->setPayload(MakeExplosionEffect(glm::vec3{}, 6, flameTexture, 6, 0.5f));
-                bullet->setTexture(glowTexture);
-                return bullet;
+                ParticleSystem::Particle bullet;
+                bullet.position = instigator.getPosition() +
+                    glm::vec3{direction * static_cast<float>(instigator.getSize() * 2.0f), 0.0f};
+                bullet.velocity = instigator.getVelocity() + direction * 100.0f;
+                bullet.texture = GlowParticle;
+                commands.spawnProjectile(bullet, MakeExplosionFlash(), MakeExplosion(glm::vec3{}, 6, 6, 0.5f));
+                return true;
             }, 0.6f);
 
             //drill
             playerActor->getWeaponList().emplace_back(
-                [&](Character &instigator, glm::vec2 direction) {
-                    return MakeExplosionEffect(instigator.getPosition() +
-                            glm::vec3{instigator.getFrontDirection() * static_cast<float>(instigator.getSize() * 1.0f), 0.0f},
-                                               2, flameTexture, 3.0f,0.1f, playerActor);
+                [](Character &instigator, glm::vec2 direction, WorldCommands &commands) {
+                    const auto front = instigator.getFrontDirection() * static_cast<float>(instigator.getSize());
+                    const auto position = instigator.getPosition() + glm::vec3{front, 0.0f};
+                    commands.explode(MakeExplosionFlash(),
+                                     MakeExplosion(position, 2, 3.0f, 0.1f, instigator.getHandle()));
+                    return true;
             }, 0.1f, std::numeric_limits<int>::max());
 
             world->addActor(playerActor);
@@ -235,12 +321,13 @@ private:
         auto generateSafePos = [this]()
         {
             std::uniform_real_distribution<float> posDistribution{-32, 256 - 32};
+            const auto spawnOrigin = WorldCenter - 128.0f;
 
             glm::vec2 pos{};
             do
             {
-                pos = {posDistribution(random), posDistribution(random)};
-            } while (length(pos - glm::vec2{128, 128}) <= 30.0);
+                pos = spawnOrigin + glm::vec2{posDistribution(random), posDistribution(random)};
+            } while (length(pos - WorldCenter) <= 30.0);
 
             return pos;
         };
@@ -249,13 +336,13 @@ private:
             for (int i = 0; i < 100; ++i)
             {
                 auto actor = std::make_shared<Enemy>();
-                actor->setTexture(smallEnemyTexture);
+                actor->setLook(SmallEnemyLook);
                 actor->setSize(2);
                 actor->setPosition({generateSafePos(), 0.0});
                 //actor->setPosition({120,120, 0.0});
                 actor->setHP(0.5f);
                 actor->setMaxSpeed(2.0);
-                actor->chasingActor = playerActor;
+                actor->chasingActor = playerActor->getHandle();
 
                 world->addActor(std::move(actor));
             }
@@ -263,13 +350,13 @@ private:
             for (int i = 0; i < 10; ++i)
             {
                 auto actor = std::make_shared<Enemy>();
-                actor->setTexture(bigEnemyTexture);
+                actor->setLook(BigEnemyLook);
                 actor->setMaxSpeed(0.5);
                 actor->setSize(4);
                 actor->setPosition({generateSafePos(), 0.0});
                 // actor->setPosition({120,120, 0.0});
                 actor->setHP(20.0f);
-                actor->chasingActor = playerActor;
+                actor->chasingActor = playerActor->getHandle();
                 actor->buildingRange = 2;
 
                 world->addActor(std::move(actor));
@@ -278,14 +365,41 @@ private:
 
 
         worldRenderer = std::make_unique<WorldRenderer>(*world, tilesAtlas);
+        worldRenderer->setParticleTextures({&flameTexture, &glowTexture});
+        worldRenderer->setActorLooks({{&tankTexture, &tankTowerTexture, &tankDrillTexture},
+                                      {&baseTexture},
+                                      {&smallEnemyTexture},
+                                      {&bigEnemyTexture}});
     }
 
-    void Update(float dt)
+    // the world goes in fixed ticks whatever the frame rate, frames draw it between the last two of them
+    void Update(float frameTime)
     {
         sf::View view{{cameraPosition.x, cameraPosition.y},
                       {static_cast<float>(window.getSize().x), static_cast<float>(window.getSize().y)}};
         window.setView(view);
 
+        if (!world)
+            return;
+
+        timestep.advance(frameTime, [this](float dt) { Tick(dt); });
+
+        const auto interpolation = timestep.getInterpolation();
+        if (playerActor && playerActor->isAlive())
+        {
+            const auto position = mix(playerActor->getPreviousPosition(), playerActor->getPosition(), interpolation);
+            cameraPosition = worldRenderer->getTransform().transformPoint(position.x, position.y);
+        }
+
+        worldRenderer->setInterpolation(interpolation, FixedTimestep::TickDuration);
+        worldRenderer->setCameraPosition(cameraPosition);
+        worldRenderer->setScale(TileScale, TileScale);
+        worldRenderer->setVisibleLayers(visibleLayer, VisibleLayersCount);
+        worldRenderer->update();
+    }
+
+    void Tick(float dt)
+    {
         // player input
         if (playerActor && playerActor->isAlive())
         {
@@ -329,24 +443,52 @@ private:
                 playerActor->setShootDirection(directionToMouse);
             }
 
-            cameraPosition = worldRenderer->getTransform().transformPoint(playerActor->getPosition().x,
-                                                                          playerActor->getPosition().y);
             visibleLayer = playerActor->getPosition().z;
 
             playerActor->setVelocity(velocity);
 
             world->trimLevelsAbove(playerActor->getPosition().z-1);
-        }
 
-        if (!world)
-            return;
+            // actors are drawn over the layer beneath them
+            const auto windowSize = glm::vec2{window.getSize().x, window.getSize().y};
+            simulationFocus.firstDepth = visibleLayer;
+            simulationFocus.views.clear();
+            for (int depth = visibleLayer; depth < visibleLayer + VisibleLayersCount - 1; ++depth)
+            {
+                const auto tiles = worldRenderer->getVisibleTiles(depth + 1, windowSize);
+                if (!tiles)
+                    break;
+                simulationFocus.views.push_back({glm::ivec2{glm::floor(tiles->first)},
+                                                 glm::ivec2{glm::ceil(tiles->second)}});
+            }
+            world->setSimulationFocus(simulationFocus);
+        }
 
+        UpdateStreamingAreas();
         world->Update(dt);
 
-        worldRenderer->setCameraPosition(cameraPosition);
-        worldRenderer->setScale(12.0, 12.0);
-        worldRenderer->setVisibleLayers(visibleLayer, 16);
-        worldRenderer->update();
+        for (const auto &explosion : world->getParticles().getExplosions())
+            ApplyExplosion(*world, explosion, explosionContacts);
+        world->getParticles().clearExplosions();
+    }
+
+    // chunks are generated around the player and under the camera, the rest of the world is unloaded
+    void UpdateStreamingAreas()
+    {
+        std::vector<World::StreamingArea> areas;
+
+        // the deepest visible layer is drawn 1.7 times smaller, so it shows more of itself
+        const auto cameraCenter = glm::ivec2{to_glm(worldRenderer->getInverseTransform().transformPoint(cameraPosition))};
+        const auto halfView = glm::ivec2{glm::vec2{window.getSize().x, window.getSize().y} / (2.0f * TileScale) * 1.7f} + 1;
+        areas.push_back({cameraCenter - halfView, cameraCenter + halfView});
+
+        if (playerActor && playerActor->isAlive())
+        {
+            const auto playerPosition = glm::ivec2{playerActor->getPositionOnLayer()};
+            areas.push_back({playerPosition - PlayerStreamingRadius, playerPosition + PlayerStreamingRadius});
+        }
+
+        world->setStreamingAreas(std::move(areas));
     }
 
     void Render()
@@ -360,17 +502,24 @@ private:
 
             window.setView(window.getDefaultView());
 
-            sf::Text text{"Resources:\n "s + std::to_string(playerActor->inventory.amountMinerals) + " minerals\n "s + 
-                std::to_string(playerActor->inventory.amountOil) + " oil.\n\n Base structure: "s + std::to_string(baseActor->getHP())
-                , font, 30};
+            // laid out again only when the numbers change
+            const auto resources = std::tuple{playerActor->inventory.amountMinerals,
+                                              playerActor->inventory.amountOil, baseActor->getHP()};
+            if (resources != shownResources)
+            {
+                shownResources = resources;
+                resourcesText.setString("Resources:\n "s + std::to_string(playerActor->inventory.amountMinerals) +
+                                        " minerals\n "s + std::to_string(playerActor->inventory.amountOil) +
+                                        " oil.\n\n Base structure: "s + std::to_string(baseActor->getHP()));
+            }
 
-            window.draw(text);
+            window.draw(resourcesText);
         }
         else
         {
             window.setView(window.getDefaultView());
 
-            sf::Text text{"Game over", font, 80};
+            auto &text = gameOverText;
             sf::Vector2u position = window.getSize() / 2u - sf::Vector2u{static_cast<unsigned>(text.getGlobalBounds().width), static_cast<unsigned>(text.getGlobalBounds().height)};
             text.setPosition(position.x, position.y);
             window.draw(text);
@@ -388,9 +537,17 @@ private:
     sf::Texture smallEnemyTexture, bigEnemyTexture;
 
     sf::Font font;
+    sf::Text resourcesText, gameOverText;
+    std::optional<std::tuple<int, int, float>> shownResources;
 
+    std::optional<uint64_t> fixedSeed;
+    uint64_t worldSeed = 0;
     std::mt19937 random;
+    std::shared_ptr<JobSystem> jobSystem = std::make_shared<JobSystem>();
     std::unique_ptr<World> world;
+    FixedTimestep timestep;
+    std::vector<Actor *> explosionContacts; // query buffer of ApplyExplosion
+    World::SimulationFocus simulationFocus; // refilled every tick, the views keep their memory
 
     std::unique_ptr<WorldRenderer> worldRenderer;
     sf::Vector2f cameraPosition = {128, 128};
@@ -400,9 +557,13 @@ private:
     std::shared_ptr<Base> baseActor = nullptr;
 };
 
-int main()
+int main(int argc, char *argv[])
 {
-    App app;
+    std::optional<uint64_t> seed;
+    if (argc > 2 && argv[1] == "--seed"sv)
+        seed = std::stoull(argv[2]);
+
+    App app{seed};
     app.Run();
 
     return EXIT_SUCCESS;
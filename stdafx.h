@@ -2,12 +2,16 @@
 #include <glm/gtx/vec_swizzle.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <future>
+#include <limits>
 #include <list>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
 #include <random>
@@ -16,6 +20,7 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>